@@ -105,6 +105,61 @@ size_t tlb_flush_count(void)
     return count;
 }
 
+#ifdef CPU_TLB_ASID_SLOTS
+/*
+ * Drop the saved address spaces of the MMU indexes in idxmap. The ASID
+ * the flushed live table was filled for is not known any more either.
+ */
+static void tlb_asid_flush(CPUArchState *env, unsigned long idxmap)
+{
+    unsigned slot;
+    int mmu_idx;
+
+    qemu_spin_lock(&env->tlb_asid_lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (test_bit(mmu_idx, &idxmap)) {
+            for (slot = 0; slot < CPU_TLB_ASID_SLOTS; slot++) {
+                env->tlb_asid_tag[slot][mmu_idx] = 0;
+            }
+            env->tlb_asid[mmu_idx] = 0;
+        }
+    }
+    qemu_spin_unlock(&env->tlb_asid_lock);
+}
+
+static void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr);
+
+/* Flush one page from the saved address spaces of the MMU indexes */
+static void tlb_asid_flush_page(CPUArchState *env, target_ulong addr,
+                                unsigned long idxmap)
+{
+    int page = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    unsigned slot;
+    int mmu_idx;
+
+    qemu_spin_lock(&env->tlb_asid_lock);
+    for (slot = 0; slot < CPU_TLB_ASID_SLOTS; slot++) {
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            if (test_bit(mmu_idx, &idxmap) &&
+                env->tlb_asid_tag[slot][mmu_idx]) {
+                tlb_flush_entry(&env->tlb_asid_table[slot][mmu_idx][page],
+                                addr);
+            }
+        }
+    }
+    qemu_spin_unlock(&env->tlb_asid_lock);
+}
+#else
+static inline void tlb_asid_flush(CPUArchState *env, unsigned long idxmap)
+{
+}
+
+static inline void tlb_asid_flush_page(CPUArchState *env, target_ulong addr,
+                                       unsigned long idxmap)
+{
+}
+#endif
+
 /* This is OK because CPU architectures generally permit an
  * implementation to drop entries from the TLB at any time, so
  * flushing more entries than required is only an efficiency issue,
@@ -129,6 +184,7 @@ static void tlb_flush_nocheck(CPUState *cpu)
 
     memset(env->tlb_table, -1, sizeof(env->tlb_table));
     memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    tlb_asid_flush(env, ALL_MMUIDX_BITS);
     cpu_tb_jmp_cache_clear(cpu);
 
     env->vtlb_index = 0;
@@ -193,6 +249,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
             memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
         }
     }
+    tlb_asid_flush(env, mmu_idx_bitmask);
 
     cpu_tb_jmp_cache_clear(cpu);
 
@@ -245,6 +302,90 @@ void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
 
 
 
+#ifdef CPU_TLB_ASID_SLOTS
+void tlb_set_asid(CPUState *cpu, uint16_t idxmap, uint32_t asid)
+{
+    CPUArchState *env = cpu->env_ptr;
+    bool changed = false;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("mmu_idx: 0x%" PRIx16 " asid: %" PRIu32 "\n", idxmap, asid);
+
+    tb_lock();
+    qemu_spin_lock(&env->tlb_asid_lock);
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        unsigned slot;
+        unsigned i;
+
+        if (!(idxmap & (1 << mmu_idx)) ||
+            env->tlb_asid[mmu_idx] == asid + 1) {
+            continue;
+        }
+        changed = true;
+
+        for (slot = 0; slot < CPU_TLB_ASID_SLOTS; slot++) {
+            if (env->tlb_asid_tag[slot][mmu_idx] == asid + 1) {
+                break;
+            }
+        }
+        if (slot < CPU_TLB_ASID_SLOTS && env->tlb_asid[mmu_idx]) {
+            /* Swap the current address space with the saved one */
+            for (i = 0; i < CPU_TLB_SIZE; i++) {
+                CPUTLBEntry tmp = env->tlb_table[mmu_idx][i];
+                CPUIOTLBEntry iotmp = env->iotlb[mmu_idx][i];
+
+                env->tlb_table[mmu_idx][i] =
+                    env->tlb_asid_table[slot][mmu_idx][i];
+                env->tlb_asid_table[slot][mmu_idx][i] = tmp;
+                env->iotlb[mmu_idx][i] = env->iotlb_asid[slot][mmu_idx][i];
+                env->iotlb_asid[slot][mmu_idx][i] = iotmp;
+            }
+        } else if (env->tlb_asid[mmu_idx]) {
+            /* Save the current address space in place of the oldest one */
+            for (slot = 0; slot < CPU_TLB_ASID_SLOTS; slot++) {
+                if (!env->tlb_asid_tag[slot][mmu_idx]) {
+                    break;
+                }
+            }
+            if (slot == CPU_TLB_ASID_SLOTS) {
+                slot = env->tlb_asid_next++ % CPU_TLB_ASID_SLOTS;
+            }
+            memcpy(env->tlb_asid_table[slot][mmu_idx], env->tlb_table[mmu_idx],
+                   sizeof(env->tlb_table[0]));
+            memcpy(env->iotlb_asid[slot][mmu_idx], env->iotlb[mmu_idx],
+                   sizeof(env->iotlb[0]));
+            memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
+        } else {
+            /* Current entries can't be tagged, drop them */
+            memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
+            slot = CPU_TLB_ASID_SLOTS;
+        }
+        if (slot < CPU_TLB_ASID_SLOTS) {
+            env->tlb_asid_tag[slot][mmu_idx] = env->tlb_asid[mmu_idx];
+        }
+        env->tlb_asid[mmu_idx] = asid + 1;
+        /* The victim TLB is not tagged, drop it */
+        memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+    }
+
+    qemu_spin_unlock(&env->tlb_asid_lock);
+
+    if (changed) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
+    tb_unlock();
+}
+#else
+void tlb_set_asid(CPUState *cpu, uint16_t idxmap, uint32_t asid)
+{
+    tlb_flush_by_mmuidx(cpu, idxmap);
+}
+#endif
+
 static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
 {
     if (addr == (tlb_entry->addr_read &
@@ -283,6 +424,7 @@ static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
     }
+    tlb_asid_flush_page(env, addr, ALL_MMUIDX_BITS);
 
     /* check whether there are entries that need to be flushed in the vtlb */
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
@@ -338,6 +480,7 @@ static void tlb_flush_page_by_mmuidx_async_work(CPUState *cpu,
             }
         }
     }
+    tlb_asid_flush_page(env, addr, mmu_idx_bitmap);
 
     tb_flush_jmp_cache(cpu, addr);
 }
@@ -534,6 +677,10 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
     int mmu_idx;
 
     env = cpu->env_ptr;
+#ifdef CPU_TLB_ASID_SLOTS
+    /* Don't let tlb_set_asid move entries between tables under our feet */
+    qemu_spin_lock(&env->tlb_asid_lock);
+#endif
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         unsigned int i;
 
@@ -546,7 +693,26 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
             tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
                                   start1, length);
         }
+#ifdef CPU_TLB_ASID_SLOTS
+        {
+            unsigned slot;
+
+            for (slot = 0; slot < CPU_TLB_ASID_SLOTS; slot++) {
+                if (!env->tlb_asid_tag[slot][mmu_idx]) {
+                    continue;
+                }
+                for (i = 0; i < CPU_TLB_SIZE; i++) {
+                    tlb_reset_dirty_range(
+                            &env->tlb_asid_table[slot][mmu_idx][i],
+                            start1, length);
+                }
+            }
+        }
+#endif
     }
+#ifdef CPU_TLB_ASID_SLOTS
+    qemu_spin_unlock(&env->tlb_asid_lock);
+#endif
 }
 
 static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
@@ -1118,6 +1118,89 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     tb_ctx.tb_phys_invalidate_count++;
 }
 
+struct tb_evict_data {
+    void *start;
+    void *end;
+    GPtrArray *tbs;
+};
+
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    struct tb_evict_data *d = data;
+
+    if ((void *)tb->tc.ptr >= d->end) {
+        return true;
+    }
+    if ((void *)tb->tc.ptr >= d->start) {
+        g_ptr_array_add(d->tbs, tb);
+    }
+    return false;
+}
+
+/* drop the translation blocks of the oldest code_gen_buffer region */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_gen)
+{
+    struct tb_evict_data d;
+    size_t region_idx;
+    guint i;
+
+    tb_lock();
+
+    /* If the buffer has been flushed or evicted on request of another CPU,
+     * just retry.
+     */
+    if (tb_ctx.tb_flush_count + tb_ctx.tb_evict_count != tb_gen.host_int) {
+        goto done;
+    }
+
+    if (!tcg_region_oldest(&region_idx, &d.start, &d.end)) {
+        unsigned tb_flush_count = tb_ctx.tb_flush_count;
+
+        tb_unlock();
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+        return;
+    }
+
+    d.tbs = g_ptr_array_new();
+    g_tree_foreach(tb_ctx.tb_tree, tb_evict_iter, &d);
+
+    if (DEBUG_TB_FLUSH_GATE) {
+        printf("qemu: evict region=%zu nb_tbs=%u\n", region_idx, d.tbs->len);
+    }
+
+    for (i = 0; i < d.tbs->len; i++) {
+        TranslationBlock *tb = g_ptr_array_index(d.tbs, i);
+
+        tb_phys_invalidate(tb, -1);
+        /* TBs invalidated earlier may still be linked */
+        tb_remove_from_jmp_list(tb, 0);
+        tb_remove_from_jmp_list(tb, 1);
+        tb_jmp_unlink(tb);
+        tb_remove(tb);
+    }
+    g_ptr_array_free(d.tbs, true);
+
+    CPU_FOREACH(cpu) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
+    tcg_region_evict(region_idx);
+    atomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+
+done:
+    tb_unlock();
+}
+
+/* Make room in code_gen_buffer, flushing it if nothing can be evicted */
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_gen = atomic_mb_read(&tb_ctx.tb_flush_count) +
+                      atomic_mb_read(&tb_ctx.tb_evict_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_INT(tb_gen));
+}
+
 #ifdef CONFIG_SOFTMMU
 static void build_page_bitmap(PageDesc *p)
 {
@@ -1262,8 +1345,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1852,8 +1935,54 @@ struct tb_tree_stats {
     size_t direct_jmp_count;
     size_t direct_jmp2_count;
     size_t cross_page;
+    /* TBs translated more than once for the same guest code */
+    GHashTable *phys_pcs;
+    size_t dup_count;
+    size_t dup_pcs;
+    size_t dup_max;
+    target_ulong dup_max_pc;
+    uint32_t dup_flags;
 };
 
+static tb_page_addr_t tb_phys_pc(const TranslationBlock *tb)
+{
+    return tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+}
+
+static guint tb_phys_pc_hash(gconstpointer p)
+{
+    uint64_t v = tb_phys_pc(p);
+
+    return v ^ (v >> 32);
+}
+
+static gboolean tb_phys_pc_equal(gconstpointer a, gconstpointer b)
+{
+    return tb_phys_pc(a) == tb_phys_pc(b);
+}
+
+static void tb_dup_stats(struct tb_tree_stats *tst, const TranslationBlock *tb)
+{
+    gpointer first, count;
+    size_t n;
+
+    if (!g_hash_table_lookup_extended(tst->phys_pcs, tb, &first, &count)) {
+        g_hash_table_insert(tst->phys_pcs, (gpointer)tb, GSIZE_TO_POINTER(1));
+        return;
+    }
+    n = GPOINTER_TO_SIZE(count) + 1;
+    g_hash_table_insert(tst->phys_pcs, first, GSIZE_TO_POINTER(n));
+    tst->dup_count++;
+    if (n == 2) {
+        tst->dup_pcs++;
+    }
+    if (n > tst->dup_max) {
+        tst->dup_max = n;
+        tst->dup_max_pc = tb->pc;
+    }
+    tst->dup_flags |= ((const TranslationBlock *)first)->flags ^ tb->flags;
+}
+
 static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
 {
     const TranslationBlock *tb = value;
@@ -1873,6 +2002,10 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
             tst->direct_jmp2_count++;
         }
     }
+    /* Invalidated TBs stay in the tree until the next flush */
+    if (!(tb->cflags & CF_INVALID)) {
+        tb_dup_stats(tst, tb);
+    }
     return false;
 }
 
@@ -1885,7 +2018,9 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     tb_lock();
 
     nb_tbs = g_tree_nnodes(tb_ctx.tb_tree);
+    tst.phys_pcs = g_hash_table_new(tb_phys_pc_hash, tb_phys_pc_equal);
     g_tree_foreach(tb_ctx.tb_tree, tb_tree_stats_iter, &tst);
+    g_hash_table_destroy(tst.phys_pcs);
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
     /*
@@ -1909,6 +2044,12 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                 nb_tbs ? (tst.direct_jmp_count * 100) / nb_tbs : 0,
                 tst.direct_jmp2_count,
                 nb_tbs ? (tst.direct_jmp2_count * 100) / nb_tbs : 0);
+    cpu_fprintf(f, "duplicate TB count  %zu (%zu%%) at %zu PCs, "
+                "max %zu at " TARGET_FMT_lx "\n",
+                tst.dup_count,
+                nb_tbs ? (tst.dup_count * 100) / nb_tbs : 0,
+                tst.dup_pcs, tst.dup_max, tst.dup_max_pc);
+    cpu_fprintf(f, "duplicate TB flags  0x%08x differ\n", tst.dup_flags);
 
     qht_statistics_init(&tb_ctx.htable, &hst);
     print_qht_statistics(f, cpu_fprintf, hst);
@@ -1917,6 +2058,8 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
+    cpu_fprintf(f, "TB evict count      %u\n",
+                atomic_read(&tb_ctx.tb_evict_count));
     cpu_fprintf(f, "TB invalidate count %d\n", tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %zu\n", tlb_flush_count());
     tcg_dump_info(f, cpu_fprintf);
@@ -0,0 +1 @@
+# Default configuration for xtensa-linux-user
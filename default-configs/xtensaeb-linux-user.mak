@@ -0,0 +1 @@
+# Default configuration for xtensaeb-linux-user
@@ -3,3 +3,5 @@
 CONFIG_SERIAL=y
 CONFIG_OPENCORES_ETH=y
 CONFIG_PFLASH_CFI01=y
+CONFIG_VIRTIO=y
+CONFIG_XTENSA_MX_PIC=y
@@ -35,8 +35,10 @@
 #include "hw/hw.h"
 #include "hw/net/mii.h"
 #include "hw/sysbus.h"
+#include "exec/address-spaces.h"
 #include "net/net.h"
 #include "net/eth.h"
+#include "qemu/iov.h"
 #include "sysemu/sysemu.h"
 #include "trace.h"
 
@@ -356,10 +358,35 @@ static int open_eth_can_receive(NetClientState *nc)
         (s->regs[TX_BD_NUM] < 0x80);
 }
 
-static ssize_t open_eth_receive(NetClientState *nc,
-        const uint8_t *buf, size_t size)
+/* Write frame data followed by zero fill to the guest RX buffer at addr */
+static void open_eth_write_frame(hwaddr addr,
+        const struct iovec *iov, int iovcnt,
+        size_t copy_size, size_t total_size)
+{
+    hwaddr plen = total_size;
+    uint8_t *p = address_space_map(&address_space_memory, addr, &plen, true);
+
+    if (p && plen == total_size) {
+        iov_to_buf(iov, iovcnt, 0, p, copy_size);
+        memset(p + copy_size, 0, total_size - copy_size);
+        address_space_unmap(&address_space_memory, p, plen, true, plen);
+    } else {
+        uint8_t *buf = g_malloc0(total_size);
+
+        if (p) {
+            address_space_unmap(&address_space_memory, p, plen, true, 0);
+        }
+        iov_to_buf(iov, iovcnt, 0, buf, copy_size);
+        cpu_physical_memory_write(addr, buf, total_size);
+        g_free(buf);
+    }
+}
+
+static ssize_t open_eth_receive_iov(NetClientState *nc,
+        const struct iovec *iov, int iovcnt)
 {
     OpenEthState *s = qemu_get_nic_opaque(nc);
+    size_t size = iov_size(iov, iovcnt);
     size_t maxfl = GET_REGFIELD(s, PACKETLEN, MAXFL);
     size_t minfl = GET_REGFIELD(s, PACKETLEN, MINFL);
     size_t fcsl = 4;
@@ -371,6 +398,9 @@ static ssize_t open_eth_receive(NetClientState *nc,
         static const uint8_t bcast_addr[] = {
             0xff, 0xff, 0xff, 0xff, 0xff, 0xff
         };
+        uint8_t buf[ETH_ALEN];
+
+        iov_to_buf(iov, iovcnt, 0, buf, sizeof(buf));
         if (memcmp(buf, bcast_addr, sizeof(bcast_addr)) == 0) {
             miss = GET_REGBIT(s, MODER, BRO);
         } else if ((buf[0] & 0x1) || GET_REGBIT(s, MODER, IAM)) {
@@ -399,9 +429,9 @@ static ssize_t open_eth_receive(NetClientState *nc,
 #else
     {
 #endif
-        static const uint8_t zero[64] = {0};
         desc *desc = rx_desc(s);
         size_t copy_size = GET_REGBIT(s, MODER, HUGEN) ? 65536 : maxfl;
+        size_t frame_size;
 
         if (!(desc->len_flags & RXD_E)) {
             open_eth_int_source_write(s,
@@ -429,32 +459,26 @@ static ssize_t open_eth_receive(NetClientState *nc,
         }
 #endif
 
-        cpu_physical_memory_write(desc->buf_ptr, buf, copy_size);
-
-        if (GET_REGBIT(s, MODER, PAD) && copy_size < minfl) {
-            if (minfl - copy_size > fcsl) {
+        frame_size = copy_size;
+        if (GET_REGBIT(s, MODER, PAD) && frame_size < minfl) {
+            if (minfl - frame_size > fcsl) {
                 fcsl = 0;
             } else {
-                fcsl -= minfl - copy_size;
-            }
-            while (copy_size < minfl) {
-                size_t zero_sz = minfl - copy_size < sizeof(zero) ?
-                    minfl - copy_size : sizeof(zero);
-
-                cpu_physical_memory_write(desc->buf_ptr + copy_size,
-                        zero, zero_sz);
-                copy_size += zero_sz;
+                fcsl -= minfl - frame_size;
             }
+            frame_size = minfl;
         }
 
         /* There's no FCS in the frames handed to us by the QEMU, zero fill it.
          * Don't do it if the frame is cut at the MAXFL or padded with 4 or
          * more bytes to the MINFL.
          */
-        cpu_physical_memory_write(desc->buf_ptr + copy_size, zero, fcsl);
-        copy_size += fcsl;
+        frame_size += fcsl;
 
-        SET_FIELD(desc->len_flags, RXD_LEN, copy_size);
+        open_eth_write_frame(desc->buf_ptr, iov, iovcnt,
+                             copy_size, frame_size);
+
+        SET_FIELD(desc->len_flags, RXD_LEN, frame_size);
 
         if ((desc->len_flags & RXD_WRAP) || s->rx_desc == 0x7f) {
             s->rx_desc = s->regs[TX_BD_NUM];
@@ -473,20 +497,49 @@ static ssize_t open_eth_receive(NetClientState *nc,
     return size;
 }
 
+static ssize_t open_eth_receive(NetClientState *nc,
+        const uint8_t *buf, size_t size)
+{
+    const struct iovec iov = {
+        .iov_base = (uint8_t *)buf,
+        .iov_len = size,
+    };
+
+    return open_eth_receive_iov(nc, &iov, 1);
+}
+
+static void open_eth_check_start_xmit(OpenEthState *s);
+
+static void open_eth_tx_complete(NetClientState *nc, ssize_t len)
+{
+    OpenEthState *s = qemu_get_nic_opaque(nc);
+
+    open_eth_check_start_xmit(s);
+}
+
 static NetClientInfo net_open_eth_info = {
     .type = NET_CLIENT_DRIVER_NIC,
     .size = sizeof(NICState),
     .can_receive = open_eth_can_receive,
     .receive = open_eth_receive,
+    .receive_iov = open_eth_receive_iov,
     .link_status_changed = open_eth_set_link_status,
 };
 
-static void open_eth_start_xmit(OpenEthState *s, desc *tx)
+/*
+ * Send the frame from the guest buffer in place when it is directly
+ * accessible, bounce it through a local buffer otherwise.
+ * Returns false if the peer queued the frame and can't take more.
+ */
+static bool open_eth_start_xmit(OpenEthState *s, desc *tx)
 {
-    uint8_t *buf = NULL;
-    uint8_t buffer[0x600];
+    static const uint8_t zero[64] = {0};
+    NetClientState *nc = qemu_get_queue(s->nic);
     unsigned len = GET_FIELD(tx->len_flags, TXD_LEN);
     unsigned tx_len = len;
+    hwaddr plen;
+    uint8_t *p;
+    ssize_t ret;
 
     if ((tx->len_flags & TXD_PAD) &&
             tx_len < GET_REGFIELD(s, PACKETLEN, MINFL)) {
@@ -499,20 +552,34 @@ static void open_eth_start_xmit(OpenEthState *s, desc *tx)
 
     trace_open_eth_start_xmit(tx->buf_ptr, len, tx_len);
 
-    if (tx_len > sizeof(buffer)) {
-        buf = g_new(uint8_t, tx_len);
-    } else {
-        buf = buffer;
-    }
     if (len > tx_len) {
         len = tx_len;
     }
-    cpu_physical_memory_read(tx->buf_ptr, buf, len);
-    if (tx_len > len) {
-        memset(buf + len, 0, tx_len - len);
-    }
-    qemu_send_packet(qemu_get_queue(s->nic), buf, tx_len);
-    if (tx_len > sizeof(buffer)) {
+
+    plen = len;
+    p = address_space_map(&address_space_memory, tx->buf_ptr, &plen, false);
+    if (p && plen == len && tx_len - len <= sizeof(zero)) {
+        struct iovec iov[] = {
+            {
+                .iov_base = p,
+                .iov_len = len,
+            }, {
+                .iov_base = (uint8_t *)zero,
+                .iov_len = tx_len - len,
+            },
+        };
+
+        ret = qemu_sendv_packet_async(nc, iov, tx_len > len ? 2 : 1,
+                                      open_eth_tx_complete);
+        address_space_unmap(&address_space_memory, p, plen, false, plen);
+    } else {
+        uint8_t *buf = g_malloc0(tx_len);
+
+        if (p) {
+            address_space_unmap(&address_space_memory, p, plen, false, 0);
+        }
+        cpu_physical_memory_read(tx->buf_ptr, buf, len);
+        ret = qemu_send_packet_async(nc, buf, tx_len, open_eth_tx_complete);
         g_free(buf);
     }
 
@@ -529,16 +596,20 @@ static void open_eth_start_xmit(OpenEthState *s, desc *tx)
     if (tx->len_flags & TXD_IRQ) {
         open_eth_int_source_write(s, s->regs[INT_SOURCE] | INT_SOURCE_TXB);
     }
-
+    return ret != 0;
 }
 
+/* Transmit all ready descriptors in one pass */
 static void open_eth_check_start_xmit(OpenEthState *s)
 {
-    desc *tx = tx_desc(s);
-    if (GET_REGBIT(s, MODER, TXEN) && s->regs[TX_BD_NUM] > 0 &&
-            (tx->len_flags & TXD_RD) &&
-            GET_FIELD(tx->len_flags, TXD_LEN) > 4) {
-        open_eth_start_xmit(s, tx);
+    while (GET_REGBIT(s, MODER, TXEN) && s->regs[TX_BD_NUM] > 0) {
+        desc *tx = tx_desc(s);
+
+        if (!(tx->len_flags & TXD_RD) ||
+            GET_FIELD(tx->len_flags, TXD_LEN) <= 4 ||
+            !open_eth_start_xmit(s, tx)) {
+            break;
+        }
     }
 }
 
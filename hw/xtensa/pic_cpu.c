@@ -30,32 +30,68 @@
 #include "hw/hw.h"
 #include "qemu/log.h"
 #include "qemu/timer.h"
+#include "qemu/main-loop.h"
+#include "sysemu/cpus.h"
 
-void check_interrupts(CPUXtensaState *env)
+int xtensa_get_pending_irq_level(CPUXtensaState *env)
 {
-    CPUState *cs = CPU(xtensa_env_get_cpu(env));
     int minlevel = xtensa_get_cintlevel(env);
-    uint32_t int_set_enabled = env->sregs[INTSET] & env->sregs[INTENABLE];
+    uint32_t int_set_enabled = atomic_read(&env->sregs[INTSET]) &
+        env->sregs[INTENABLE];
     int level;
 
     for (level = env->config->nlevel; level > minlevel; --level) {
         if (env->config->level_mask[level] & int_set_enabled) {
-            env->pending_irq_level = level;
-            cpu_interrupt(cs, CPU_INTERRUPT_HARD);
-            qemu_log_mask(CPU_LOG_INT,
-                    "%s level = %d, cintlevel = %d, "
-                    "pc = %08x, a0 = %08x, ps = %08x, "
-                    "intset = %08x, intenable = %08x, "
-                    "ccount = %08x\n",
-                    __func__, level, xtensa_get_cintlevel(env),
-                    env->pc, env->regs[0], env->sregs[PS],
-                    env->sregs[INTSET], env->sregs[INTENABLE],
-                    env->sregs[CCOUNT]);
-            return;
+            return level;
         }
     }
-    env->pending_irq_level = 0;
-    cpu_reset_interrupt(cs, CPU_INTERRUPT_HARD);
+    return 0;
+}
+
+/* Called with BQL held */
+void check_interrupts(CPUXtensaState *env)
+{
+    CPUState *cs = CPU(xtensa_env_get_cpu(env));
+    int level = xtensa_get_pending_irq_level(env);
+
+    atomic_set(&env->pending_irq_level, level);
+    if (level) {
+        cpu_interrupt(cs, CPU_INTERRUPT_HARD);
+        qemu_log_mask(CPU_LOG_INT,
+                "%s level = %d, cintlevel = %d, "
+                "pc = %08x, a0 = %08x, ps = %08x, "
+                "intset = %08x, intenable = %08x, "
+                "ccount = %08x\n",
+                __func__, level, xtensa_get_cintlevel(env),
+                env->pc, env->regs[0], env->sregs[PS],
+                env->sregs[INTSET], env->sregs[INTENABLE],
+                env->sregs[CCOUNT]);
+    } else {
+        cpu_reset_interrupt(cs, CPU_INTERRUPT_HARD);
+    }
+}
+
+/*
+ * Re-evaluate pending interrupts from the vCPU thread. INTSET is only
+ * changed atomically, so the BQL is needed only when CPU_INTERRUPT_HARD
+ * must be raised or reset because the pending level has changed.
+ */
+void check_interrupts_local(CPUXtensaState *env)
+{
+    CPUState *cs = CPU(xtensa_env_get_cpu(env));
+    int level;
+
+    /* Pairs with the atomic INTSET update in xtensa_set_irq */
+    smp_mb();
+    level = xtensa_get_pending_irq_level(env);
+    if (level == atomic_read(&env->pending_irq_level) &&
+        !level == !(atomic_read(&cs->interrupt_request) &
+                    CPU_INTERRUPT_HARD)) {
+        return;
+    }
+    qemu_mutex_lock_iothread();
+    check_interrupts(env);
+    qemu_mutex_unlock_iothread();
 }
 
 static void xtensa_set_irq(void *opaque, int irq, int active)
@@ -67,13 +103,23 @@ static void xtensa_set_irq(void *opaque, int irq, int active)
     } else {
         uint32_t irq_bit = 1 << irq;
 
+        /* The vCPU changes INTSET without the BQL */
         if (active) {
-            env->sregs[INTSET] |= irq_bit;
+            atomic_or(&env->sregs[INTSET], irq_bit);
         } else if (env->config->interrupt[irq].inttype == INTTYPE_LEVEL) {
-            env->sregs[INTSET] &= ~irq_bit;
+            atomic_and(&env->sregs[INTSET], ~irq_bit);
         }
 
-        check_interrupts(env);
+        if (qemu_mutex_iothread_locked()) {
+            check_interrupts(env);
+        } else {
+            /*
+             * Raised by another vCPU through the MX PIC: kick this CPU,
+             * it re-evaluates interrupts in its own thread when it
+             * enters cpu_exec again.
+             */
+            qemu_cpu_kick(CPU(xtensa_env_get_cpu(env)));
+        }
     }
 }
 
@@ -91,6 +137,83 @@ static void xtensa_ccompare_cb(void *opaque)
     xtensa_timer_irq(env, i, 1);
 }
 
+uint32_t xtensa_ccount_insns_get(CPUXtensaState *env)
+{
+    return env->ccount_deadline - env->ccount_budget;
+}
+
+void xtensa_ccount_insns_set(CPUXtensaState *env, uint32_t v)
+{
+    uint64_t budget = INT32_MAX;
+    unsigned i;
+
+    for (i = 0; i < env->config->nccompare; ++i) {
+        uint64_t dcc = (uint64_t)(env->sregs[CCOMPARE + i] - v - 1) + 1;
+
+        budget = MIN(budget, dcc);
+    }
+    env->sregs[CCOUNT] = v;
+    env->ccount_sync = v;
+    env->ccount_budget = budget;
+    env->ccount_deadline = v + budget;
+}
+
+/*
+ * Move CCOUNT forward to v raising timer interrupts for all CCOMPARE
+ * registers matched on the way.
+ */
+void xtensa_ccount_insns_advance(CPUXtensaState *env, uint32_t v)
+{
+    uint32_t elapsed = v - env->ccount_sync;
+    unsigned i;
+
+    for (i = 0; i < env->config->nccompare; ++i) {
+        if (env->sregs[CCOMPARE + i] - env->ccount_sync - 1 < elapsed) {
+            qemu_mutex_lock_iothread();
+            xtensa_timer_irq(env, i, 1);
+            qemu_mutex_unlock_iothread();
+        }
+    }
+    xtensa_ccount_insns_set(env, v);
+}
+
+/*
+ * No instructions are executed in waiti, so let CCOUNT follow the virtual
+ * clock until the CPU is woken up.
+ */
+void xtensa_ccount_insns_halt(CPUXtensaState *env)
+{
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint32_t v = xtensa_ccount_insns_get(env);
+    unsigned i;
+
+    env->ccount_halted = true;
+    env->time_base = now;
+    env->ccount_base = v;
+    for (i = 0; i < env->config->nccompare; ++i) {
+        uint64_t dcc = (uint64_t)(env->sregs[CCOMPARE + i] - v - 1) + 1;
+
+        timer_mod(env->ccompare[i].timer,
+                  now + (dcc * 1000000) / env->config->clock_freq_khz);
+    }
+    xtensa_ccount_insns_set(env, v);
+}
+
+void xtensa_ccount_insns_resume(CPUXtensaState *env)
+{
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    unsigned i;
+
+    for (i = 0; i < env->config->nccompare; ++i) {
+        timer_del(env->ccompare[i].timer);
+    }
+    env->ccount_halted = false;
+    xtensa_ccount_insns_advance(env, env->ccount_base +
+                                (uint32_t)((now - env->time_base) *
+                                           env->config->clock_freq_khz /
+                                           1000000));
+}
+
 void xtensa_irq_init(CPUXtensaState *env)
 {
     env->irq_inputs = (void **)qemu_allocate_irqs(
@@ -105,6 +228,14 @@ void xtensa_irq_init(CPUXtensaState *env)
             env->ccompare[i].timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                     xtensa_ccompare_cb, env->ccompare + i);
         }
+        if (use_icount) {
+            env->ccount_insns = false;
+        }
+        if (env->ccount_insns) {
+            xtensa_ccount_insns_set(env, env->sregs[CCOUNT]);
+        }
+    } else {
+        env->ccount_insns = false;
     }
 }
 
@@ -119,3 +250,26 @@ void *xtensa_get_extint(CPUXtensaState *env, unsigned extint)
         return NULL;
     }
 }
+
+void **xtensa_get_extints(CPUXtensaState *env)
+{
+    void **extints = g_new(void *, env->config->nextint);
+    unsigned i;
+
+    for (i = 0; i < env->config->nextint; ++i) {
+        extints[i] = env->irq_inputs[env->config->extint[i]];
+    }
+    return extints;
+}
+
+static void xtensa_set_runstall(void *opaque, int irq, int active)
+{
+    CPUXtensaState *env = opaque;
+
+    xtensa_runstall(env, active);
+}
+
+void *xtensa_get_runstall(CPUXtensaState *env)
+{
+    return qemu_allocate_irq(xtensa_set_runstall, env, 0);
+}
@@ -37,15 +37,27 @@
 #include "hw/char/serial.h"
 #include "net/net.h"
 #include "hw/sysbus.h"
+#include "hw/intc/xtensa_mx_pic.h"
 #include "hw/block/flash.h"
 #include "sysemu/block-backend.h"
 #include "chardev/char.h"
 #include "sysemu/device_tree.h"
 #include "qemu/error-report.h"
 #include "qemu/option.h"
+#include "qapi/visitor.h"
 #include "bootparam.h"
 #include "xtensa_memory.h"
 
+#define TYPE_XTFPGA_MACHINE MACHINE_TYPE_NAME("xtfpga")
+#define XTFPGA_MACHINE(obj) \
+    OBJECT_CHECK(XtfpgaMachineState, (obj), TYPE_XTFPGA_MACHINE)
+
+typedef struct XtfpgaMachineState {
+    MachineState parent_obj;
+
+    uint32_t virtio_num;
+} XtfpgaMachineState;
+
 typedef struct XtfpgaFlashDesc {
     hwaddr base;
     size_t size;
@@ -159,6 +171,89 @@ static void xtfpga_net_init(MemoryRegion *address_space,
     memory_region_add_subregion(address_space, buffers, ram);
 }
 
+/*
+ * A bank of virtio-mmio transports, one external interrupt each, starting
+ * right after the interrupts used by the UART and the ethernet MAC.
+ */
+#define XTFPGA_VIRTIO_BASE 0x0d100000
+#define XTFPGA_VIRTIO_SIZE 0x200
+#define XTFPGA_VIRTIO_EXTINT 2
+#define XTFPGA_VIRTIO_NUM 8
+#define XTFPGA_VIRTIO_MAX 32
+
+/*
+ * With the MX PIC external interrupt k is routed through MX input k + 1
+ * (input 0 is unused) and reaches the CPU shifted past the IPI interrupts,
+ * as CPU external interrupt k + 3.
+ */
+#define XTFPGA_MX_EXTINT_OFFSET 3
+
+static unsigned xtfpga_virtio_num(XtfpgaMachineState *xms,
+                                  CPUXtensaState *env, bool mx)
+{
+    unsigned first = XTFPGA_VIRTIO_EXTINT +
+        (mx ? XTFPGA_MX_EXTINT_OFFSET : 0);
+    unsigned avail = 0;
+
+    if (env->config->nextint > first) {
+        avail = env->config->nextint - first;
+    }
+    if (xms->virtio_num > avail) {
+        warn_report("core %s has external interrupts for only %u "
+                    "virtio-mmio transports", env->config->name, avail);
+        return avail;
+    }
+    return xms->virtio_num;
+}
+
+static void xtfpga_virtio_init(MemoryRegion *address_space,
+                               qemu_irq *extints, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; ++i) {
+        DeviceState *dev = qdev_create(NULL, "virtio-mmio");
+        SysBusDevice *s = SYS_BUS_DEVICE(dev);
+
+        qdev_init_nofail(dev);
+        sysbus_connect_irq(s, 0, extints[XTFPGA_VIRTIO_EXTINT + i]);
+        memory_region_add_subregion(address_space,
+                                    XTFPGA_VIRTIO_BASE +
+                                    i * XTFPGA_VIRTIO_SIZE,
+                                    sysbus_mmio_get_region(s, 0));
+    }
+}
+
+#ifdef CONFIG_FDT
+/*
+ * Describe the virtio-mmio transports in the guest device tree, relying on
+ * the root node interrupt-parent being the xtensa PIC with two-cell
+ * (interrupt number, external flag) interrupt specifiers.
+ */
+static void xtfpga_virtio_fdt(void *fdt, hwaddr io_base, unsigned n)
+{
+    uint32_t acells = qemu_fdt_getprop_cell(fdt, "/", "#address-cells",
+                                            NULL, &error_fatal);
+    uint32_t scells = qemu_fdt_getprop_cell(fdt, "/", "#size-cells",
+                                            NULL, &error_fatal);
+    unsigned i;
+
+    for (i = 0; i < n; ++i) {
+        hwaddr base = io_base + XTFPGA_VIRTIO_BASE + i * XTFPGA_VIRTIO_SIZE;
+        char *nodename = g_strdup_printf("/virtio_mmio@%" HWADDR_PRIx, base);
+
+        qemu_fdt_add_subnode(fdt, nodename);
+        qemu_fdt_setprop_string(fdt, nodename, "compatible", "virtio,mmio");
+        qemu_fdt_setprop_sized_cells(fdt, nodename, "reg",
+                                     acells, base,
+                                     scells, XTFPGA_VIRTIO_SIZE);
+        qemu_fdt_setprop_cells(fdt, nodename, "interrupts",
+                               XTFPGA_VIRTIO_EXTINT + i, 1);
+        g_free(nodename);
+    }
+}
+#endif
+
 static pflash_t *xtfpga_flash_init(MemoryRegion *address_space,
                                    const XtfpgaBoardDesc *board,
                                    DriveInfo *dinfo, int be)
@@ -223,26 +318,57 @@ static void xtfpga_init(const XtfpgaBoardDesc *board, MachineState *machine)
     XtensaCPU *cpu = NULL;
     CPUXtensaState *env = NULL;
     MemoryRegion *system_io;
+    XtensaMxPic *mx_pic = NULL;
+    qemu_irq *extints;
     DriveInfo *dinfo;
     pflash_t *flash = NULL;
     QemuOpts *machine_opts = qemu_get_machine_opts();
     const char *kernel_filename = qemu_opt_get(machine_opts, "kernel");
     const char *kernel_cmdline = qemu_opt_get(machine_opts, "append");
     const char *dtb_filename = qemu_opt_get(machine_opts, "dtb");
+    unsigned virtio_num;
     const char *initrd_filename = qemu_opt_get(machine_opts, "initrd");
     const unsigned system_io_size = 224 * 1024 * 1024;
     int n;
 
+    if (smp_cpus > 1) {
+        mx_pic = xtensa_mx_pic_init(31);
+        qemu_register_reset(xtensa_mx_pic_reset, mx_pic);
+    }
     for (n = 0; n < smp_cpus; n++) {
-        cpu = XTENSA_CPU(cpu_create(machine->cpu_type));
-        env = &cpu->env;
+        XtensaCPU *cpu_n = XTENSA_CPU(cpu_create(machine->cpu_type));
+        CPUXtensaState *cenv = &cpu_n->env;
 
-        env->sregs[PRID] = n;
-        qemu_register_reset(xtfpga_reset, cpu);
+        /* The first CPU boots the system */
+        if (!cpu) {
+            cpu = cpu_n;
+            env = cenv;
+        }
+
+        cenv->sregs[PRID] = n;
+        if (mx_pic) {
+            MemoryRegion *mx_eri;
+
+            /* Secondary CPUs start from the alternate reset vector */
+            xtensa_select_static_vectors(cenv, n != 0);
+            mx_eri = xtensa_mx_pic_register_cpu(mx_pic,
+                    (qemu_irq *)xtensa_get_extints(cenv),
+                    cenv->config->nextint,
+                    xtensa_get_runstall(cenv));
+            memory_region_add_subregion(xtensa_get_er_region(cenv),
+                                        0, mx_eri);
+        }
+        qemu_register_reset(xtfpga_reset, cpu_n);
         /* Need MMU initialized prior to ELF loading,
          * so that ELF gets loaded into virtual addresses
          */
-        cpu_reset(CPU(cpu));
+        cpu_reset(CPU(cpu_n));
+    }
+
+    if (mx_pic) {
+        extints = xtensa_mx_pic_get_extints(mx_pic);
+    } else {
+        extints = (qemu_irq *)xtensa_get_extints(env);
     }
 
     if (env) {
@@ -275,16 +401,20 @@ static void xtfpga_init(const XtfpgaBoardDesc *board, MachineState *machine)
     xtfpga_fpga_init(system_io, 0x0d020000);
     if (nd_table[0].used) {
         xtfpga_net_init(system_io, 0x0d030000, 0x0d030400, 0x0d800000,
-                xtensa_get_extint(env, 1), nd_table);
+                extints[1], nd_table);
     }
 
     if (!serial_hds[0]) {
         serial_hds[0] = qemu_chr_new("serial0", "null");
     }
 
-    serial_mm_init(system_io, 0x0d050020, 2, xtensa_get_extint(env, 0),
+    serial_mm_init(system_io, 0x0d050020, 2, extints[0],
             115200, serial_hds[0], DEVICE_NATIVE_ENDIAN);
 
+    virtio_num = xtfpga_virtio_num(XTFPGA_MACHINE(machine), env,
+                                   mx_pic != NULL);
+    xtfpga_virtio_init(system_io, extints, virtio_num);
+
     dinfo = drive_get(IF_PFLASH, 0, 0);
     if (dinfo) {
         flash = xtfpga_flash_init(system_io, board, dinfo, be);
@@ -344,6 +474,14 @@ static void xtfpga_init(const XtfpgaBoardDesc *board, MachineState *machine)
                 exit(EXIT_FAILURE);
             }
 
+            /*
+             * The interrupt specifiers only describe the uniprocessor PIC,
+             * with the MX PIC the guest is left to find the transports
+             * through its command line.
+             */
+            if (!mx_pic) {
+                xtfpga_virtio_fdt(fdt, board->io[0], virtio_num);
+            }
             cpu_physical_memory_write(cur_lowmem, fdt, fdt_size);
             cur_tagptr = put_tag(cur_tagptr, BP_TAG_FDT,
                                  sizeof(dtb_addr), &dtb_addr);
@@ -564,19 +702,75 @@ static void xtfpga_kc705_nommu_init(MachineState *machine)
     xtfpga_init(&kc705_board, machine);
 }
 
+static void xtfpga_get_virtio_transports(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    XtfpgaMachineState *xms = XTFPGA_MACHINE(obj);
+
+    visit_type_uint32(v, name, &xms->virtio_num, errp);
+}
+
+static void xtfpga_set_virtio_transports(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    XtfpgaMachineState *xms = XTFPGA_MACHINE(obj);
+    Error *local_err = NULL;
+    uint32_t value;
+
+    visit_type_uint32(v, name, &value, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    if (value > XTFPGA_VIRTIO_MAX) {
+        error_setg(errp, "at most %d virtio-mmio transports are supported",
+                   XTFPGA_VIRTIO_MAX);
+        return;
+    }
+    xms->virtio_num = value;
+}
+
+static void xtfpga_machine_initfn(Object *obj)
+{
+    XtfpgaMachineState *xms = XTFPGA_MACHINE(obj);
+
+    xms->virtio_num = XTFPGA_VIRTIO_NUM;
+}
+
+static void xtfpga_machine_class_init(ObjectClass *oc, void *data)
+{
+    object_class_property_add(oc, "virtio-transports", "uint32",
+                              xtfpga_get_virtio_transports,
+                              xtfpga_set_virtio_transports,
+                              NULL, NULL, &error_abort);
+    object_class_property_set_description(oc, "virtio-transports",
+            "Number of virtio-mmio transports", &error_abort);
+}
+
+static const TypeInfo xtfpga_machine_type = {
+    .name = TYPE_XTFPGA_MACHINE,
+    .parent = TYPE_MACHINE,
+    .abstract = true,
+    .instance_size = sizeof(XtfpgaMachineState),
+    .instance_init = xtfpga_machine_initfn,
+    .class_init = xtfpga_machine_class_init,
+};
+
 static void xtfpga_lx60_class_init(ObjectClass *oc, void *data)
 {
     MachineClass *mc = MACHINE_CLASS(oc);
 
     mc->desc = "lx60 EVB (" XTENSA_DEFAULT_CPU_MODEL ")";
     mc->init = xtfpga_lx60_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
 }
 
 static const TypeInfo xtfpga_lx60_type = {
     .name = MACHINE_TYPE_NAME("lx60"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_lx60_class_init,
 };
 
@@ -586,13 +780,13 @@ static void xtfpga_lx60_nommu_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "lx60 noMMU EVB (" XTENSA_DEFAULT_CPU_NOMMU_MODEL ")";
     mc->init = xtfpga_lx60_nommu_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_NOMMU_TYPE;
 }
 
 static const TypeInfo xtfpga_lx60_nommu_type = {
     .name = MACHINE_TYPE_NAME("lx60-nommu"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_lx60_nommu_class_init,
 };
 
@@ -602,13 +796,13 @@ static void xtfpga_lx200_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "lx200 EVB (" XTENSA_DEFAULT_CPU_MODEL ")";
     mc->init = xtfpga_lx200_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
 }
 
 static const TypeInfo xtfpga_lx200_type = {
     .name = MACHINE_TYPE_NAME("lx200"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_lx200_class_init,
 };
 
@@ -618,13 +812,13 @@ static void xtfpga_lx200_nommu_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "lx200 noMMU EVB (" XTENSA_DEFAULT_CPU_NOMMU_MODEL ")";
     mc->init = xtfpga_lx200_nommu_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_NOMMU_TYPE;
 }
 
 static const TypeInfo xtfpga_lx200_nommu_type = {
     .name = MACHINE_TYPE_NAME("lx200-nommu"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_lx200_nommu_class_init,
 };
 
@@ -634,13 +828,13 @@ static void xtfpga_ml605_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "ml605 EVB (" XTENSA_DEFAULT_CPU_MODEL ")";
     mc->init = xtfpga_ml605_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
 }
 
 static const TypeInfo xtfpga_ml605_type = {
     .name = MACHINE_TYPE_NAME("ml605"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_ml605_class_init,
 };
 
@@ -650,13 +844,13 @@ static void xtfpga_ml605_nommu_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "ml605 noMMU EVB (" XTENSA_DEFAULT_CPU_NOMMU_MODEL ")";
     mc->init = xtfpga_ml605_nommu_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_NOMMU_TYPE;
 }
 
 static const TypeInfo xtfpga_ml605_nommu_type = {
     .name = MACHINE_TYPE_NAME("ml605-nommu"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_ml605_nommu_class_init,
 };
 
@@ -666,13 +860,13 @@ static void xtfpga_kc705_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "kc705 EVB (" XTENSA_DEFAULT_CPU_MODEL ")";
     mc->init = xtfpga_kc705_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_TYPE;
 }
 
 static const TypeInfo xtfpga_kc705_type = {
     .name = MACHINE_TYPE_NAME("kc705"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_kc705_class_init,
 };
 
@@ -682,18 +876,19 @@ static void xtfpga_kc705_nommu_class_init(ObjectClass *oc, void *data)
 
     mc->desc = "kc705 noMMU EVB (" XTENSA_DEFAULT_CPU_NOMMU_MODEL ")";
     mc->init = xtfpga_kc705_nommu_init;
-    mc->max_cpus = 4;
+    mc->max_cpus = 32;
     mc->default_cpu_type = XTENSA_DEFAULT_CPU_NOMMU_TYPE;
 }
 
 static const TypeInfo xtfpga_kc705_nommu_type = {
     .name = MACHINE_TYPE_NAME("kc705-nommu"),
-    .parent = TYPE_MACHINE,
+    .parent = TYPE_XTFPGA_MACHINE,
     .class_init = xtfpga_kc705_nommu_class_init,
 };
 
 static void xtfpga_machines_init(void)
 {
+    type_register_static(&xtfpga_machine_type);
     type_register_static(&xtfpga_lx60_type);
     type_register_static(&xtfpga_lx200_type);
     type_register_static(&xtfpga_ml605_type);
@@ -25,6 +25,7 @@
 
 #include "qemu/host-utils.h"
 #include "qemu/queue.h"
+#include "qemu/thread.h"
 #ifdef CONFIG_TCG
 #include "tcg-target.h"
 #endif
@@ -87,9 +88,21 @@ typedef uint64_t target_ulong;
  * could be something like 0xC000 (the offset of the last TLB table) plus
  * 0x18 (the offset of the addend field in each TLB entry) plus the offset
  * of tlb_table inside env (which is non-trivial but not huge).
+ *
+ * The TLB has at most 2^CPU_TLB_BITS_MAX entries per MMU mode.  Targets
+ * whose guests have large working sets may raise it in cpu.h, TCG targets
+ * that can't mask larger TLB index with an immediate limit it with
+ * TCG_TARGET_TLB_MAX_INDEX_BITS.
  */
+#ifndef CPU_TLB_BITS_MAX
+#define CPU_TLB_BITS_MAX 8
+#endif
+#ifndef TCG_TARGET_TLB_MAX_INDEX_BITS
+#define TCG_TARGET_TLB_MAX_INDEX_BITS CPU_TLB_BITS_MAX
+#endif
+
 #define CPU_TLB_BITS                                             \
-    MIN(8,                                                       \
+    MIN(MIN(CPU_TLB_BITS_MAX, TCG_TARGET_TLB_MAX_INDEX_BITS),    \
         TCG_TARGET_TLB_DISPLACEMENT_BITS - CPU_TLB_ENTRY_BITS -  \
         (NB_MMU_MODES <= 1 ? 0 :                                 \
          NB_MMU_MODES <= 2 ? 1 :                                 \
@@ -131,6 +144,25 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+#ifdef CPU_TLB_ASID_SLOTS
+/* Saved TLB tables of recently used address spaces, see tlb_set_asid().
+ * Slot tags and current ASIDs hold the ASID + 1, 0 marks an unused slot
+ * or a current ASID that is not known yet.
+ */
+#define CPU_COMMON_TLB_ASID                                             \
+    CPUTLBEntry tlb_asid_table[CPU_TLB_ASID_SLOTS][NB_MMU_MODES]        \
+                              [CPU_TLB_SIZE];                           \
+    CPUIOTLBEntry iotlb_asid[CPU_TLB_ASID_SLOTS][NB_MMU_MODES]          \
+                            [CPU_TLB_SIZE];                             \
+    uint32_t tlb_asid_tag[CPU_TLB_ASID_SLOTS][NB_MMU_MODES];            \
+    uint32_t tlb_asid[NB_MMU_MODES];                                    \
+    unsigned tlb_asid_next;                                             \
+    QemuSpin tlb_asid_lock;                                             \
+
+#else
+#define CPU_COMMON_TLB_ASID
+#endif
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
     CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
@@ -141,6 +173,7 @@ typedef struct CPUIOTLBEntry {
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;                                        \
     target_ulong vtlb_index;                                            \
+    CPU_COMMON_TLB_ASID                                                 \
 
 #else
 
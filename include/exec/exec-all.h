@@ -218,6 +218,19 @@ void tlb_flush_by_mmuidx_all_cpus(CPUState *cpu, uint16_t idxmap);
  * depend on when the guests translation ends the TB.
  */
 void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *cpu, uint16_t idxmap);
+/**
+ * tlb_set_asid:
+ * @cpu: CPU whose TLB should be switched, must be the current CPU
+ * @idxmap: bitmap of MMU indexes to switch
+ * @asid: address space ID to switch to
+ *
+ * Switch the specified MMU indexes to the address space @asid. Targets
+ * that define CPU_TLB_ASID_SLOTS keep the TLB contents of the few most
+ * recently used address spaces, so switching back to one of them does
+ * not start from an empty TLB. Otherwise this is tlb_flush_by_mmuidx.
+ * Flushes apply to the saved TLB contents as well.
+ */
+void tlb_set_asid(CPUState *cpu, uint16_t idxmap, uint32_t asid);
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -283,6 +296,9 @@ static inline void tlb_flush_page_by_mmuidx(CPUState *cpu,
 static inline void tlb_flush_by_mmuidx(CPUState *cpu, uint16_t idxmap)
 {
 }
+static inline void tlb_set_asid(CPUState *cpu, uint16_t idxmap, uint32_t asid)
+{
+}
 static inline void tlb_flush_page_by_mmuidx_all_cpus(CPUState *cpu,
                                                      target_ulong addr,
                                                      uint16_t idxmap)
@@ -696,6 +696,8 @@ static inline int regpairs_aligned(void *cpu_env, int num) { return 1; }
  * of registers which translates to the same as ARM/MIPS, because we start with
  * r3 as arg1 */
 static inline int regpairs_aligned(void *cpu_env, int num) { return 1; }
+#elif defined(TARGET_XTENSA)
+static inline int regpairs_aligned(void *cpu_env, int num) { return 1; }
 #elif defined(TARGET_SH4)
 /* SH4 doesn't align register pairs, except for p{read,write}64 */
 static inline int regpairs_aligned(void *cpu_env, int num)
@@ -4229,12 +4231,13 @@ static inline abi_long target_to_host_ipc_perm(struct ipc_perm *host_ip,
     host_ip->gid = tswap32(target_ip->gid);
     host_ip->cuid = tswap32(target_ip->cuid);
     host_ip->cgid = tswap32(target_ip->cgid);
-#if defined(TARGET_ALPHA) || defined(TARGET_MIPS) || defined(TARGET_PPC)
+#if defined(TARGET_ALPHA) || defined(TARGET_MIPS) || defined(TARGET_PPC) || \
+    defined(TARGET_XTENSA)
     host_ip->mode = tswap32(target_ip->mode);
 #else
     host_ip->mode = tswap16(target_ip->mode);
 #endif
-#if defined(TARGET_PPC)
+#if defined(TARGET_PPC) || defined(TARGET_XTENSA)
     host_ip->__seq = tswap32(target_ip->__seq);
 #else
     host_ip->__seq = tswap16(target_ip->__seq);
@@ -4257,12 +4260,13 @@ static inline abi_long host_to_target_ipc_perm(abi_ulong target_addr,
     target_ip->gid = tswap32(host_ip->gid);
     target_ip->cuid = tswap32(host_ip->cuid);
     target_ip->cgid = tswap32(host_ip->cgid);
-#if defined(TARGET_ALPHA) || defined(TARGET_MIPS) || defined(TARGET_PPC)
+#if defined(TARGET_ALPHA) || defined(TARGET_MIPS) || defined(TARGET_PPC) || \
+    defined(TARGET_XTENSA)
     target_ip->mode = tswap32(host_ip->mode);
 #else
     target_ip->mode = tswap16(host_ip->mode);
 #endif
-#if defined(TARGET_PPC)
+#if defined(TARGET_PPC) || defined(TARGET_XTENSA)
     target_ip->__seq = tswap32(host_ip->__seq);
 #else
     target_ip->__seq = tswap16(host_ip->__seq);
@@ -6485,11 +6489,11 @@ static int target_to_host_fcntl_cmd(int cmd)
 #endif
         case TARGET_F_NOTIFY:
             return F_NOTIFY;
-#ifdef F_GETOWN_EX
+#if defined(F_GETOWN_EX) && defined(TARGET_F_GETOWN_EX)
 	case TARGET_F_GETOWN_EX:
 	    return F_GETOWN_EX;
 #endif
-#ifdef F_SETOWN_EX
+#if defined(F_SETOWN_EX) && defined(TARGET_F_SETOWN_EX)
 	case TARGET_F_SETOWN_EX:
 	    return F_SETOWN_EX;
 #endif
@@ -6643,7 +6647,7 @@ static inline abi_long copy_to_user_flock64(abi_ulong target_flock_addr,
 static abi_long do_fcntl(int fd, int cmd, abi_ulong arg)
 {
     struct flock64 fl64;
-#ifdef F_GETOWN_EX
+#if defined(F_GETOWN_EX) && defined(TARGET_F_GETOWN_EX)
     struct f_owner_ex fox;
     struct target_f_owner_ex *target_fox;
 #endif
@@ -6706,7 +6710,7 @@ static abi_long do_fcntl(int fd, int cmd, abi_ulong arg)
                                                           fcntl_flags_tbl)));
         break;
 
-#ifdef F_GETOWN_EX
+#if defined(F_GETOWN_EX) && defined(TARGET_F_GETOWN_EX)
     case TARGET_F_GETOWN_EX:
         ret = get_errno(safe_fcntl(fd, host_cmd, &fox));
         if (ret >= 0) {
@@ -6719,7 +6723,7 @@ static abi_long do_fcntl(int fd, int cmd, abi_ulong arg)
         break;
 #endif
 
-#ifdef F_SETOWN_EX
+#if defined(F_SETOWN_EX) && defined(TARGET_F_SETOWN_EX)
     case TARGET_F_SETOWN_EX:
         if (!lock_user_struct(VERIFY_READ, target_fox, arg, 1))
             return -TARGET_EFAULT;
@@ -11492,7 +11496,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 
 #ifdef TARGET_NR_fadvise64_64
     case TARGET_NR_fadvise64_64:
-#if defined(TARGET_PPC)
+#if defined(TARGET_PPC) || defined(TARGET_XTENSA)
         /* 6 args: fd, advice, offset (high, low), len (high, low) */
         ret = arg2;
         arg2 = arg3;
@@ -0,0 +1,35 @@
+/*
+ * Xtensa-specific CPU ABI and functions for linux-user
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef XTENSA_TARGET_CPU_H
+#define XTENSA_TARGET_CPU_H
+
+static inline void cpu_clone_regs(CPUXtensaState *env, target_ulong newsp)
+{
+    /* The register window pointer still refers to the parent's copy. */
+    env->regs = env->phys_regs + env->sregs[WINDOW_BASE] * 4;
+
+    if (newsp) {
+        uint32_t regs[16];
+
+        /* The child starts on a fresh stack with only the current
+         * window live, as if all caller frames had been spilled.
+         */
+        memcpy(regs, env->regs, sizeof(regs));
+        xtensa_rotate_window(env, -env->sregs[WINDOW_BASE]);
+        memcpy(env->regs, regs, sizeof(regs));
+        env->regs[1] = newsp;
+        env->sregs[WINDOW_START] = 0x1;
+    }
+    env->regs[2] = 0;
+}
+
+static inline void cpu_set_tls(CPUXtensaState *env, target_ulong newtls)
+{
+    env->uregs[THREADPTR] = newtls;
+}
+
+#endif
@@ -34,6 +34,7 @@
 #include "qemu-common.h"
 #include "migration/vmstate.h"
 #include "exec/exec-all.h"
+#include "hw/qdev-properties.h"
 
 
 static void xtensa_cpu_set_pc(CPUState *cs, vaddr value)
@@ -47,8 +48,31 @@ static bool xtensa_cpu_has_work(CPUState *cs)
 {
     XtensaCPU *cpu = XTENSA_CPU(cs);
 
-    return !cpu->env.runstall && cpu->env.pending_irq_level;
+#ifndef CONFIG_USER_ONLY
+    /*
+     * IPIs from other vCPUs only update INTSET, pending_irq_level of a
+     * halted CPU is refreshed in xtensa_cpu_exec_enter.
+     */
+    return !cpu->env.runstall && !cpu->env.semihosting_pending &&
+        xtensa_get_pending_irq_level(&cpu->env);
+#else
+    return !cpu->env.runstall && !cpu->env.semihosting_pending &&
+        cpu->env.pending_irq_level;
+#endif
+}
+
+#ifndef CONFIG_USER_ONLY
+static void xtensa_cpu_exec_enter(CPUState *cs)
+{
+    CPUXtensaState *env = &XTENSA_CPU(cs)->env;
+
+    if (env->ccount_halted) {
+        xtensa_ccount_insns_resume(env);
+    }
+    check_interrupts_local(env);
+    xtensa_fold_l32r_check_watchpoints(env);
 }
+#endif
 
 /* CPUClass::reset() */
 static void xtensa_cpu_reset(CPUState *s)
@@ -62,8 +86,21 @@ static void xtensa_cpu_reset(CPUState *s)
     env->exception_taken = 0;
     env->pc = env->config->exception_vector[EXC_RESET0 + env->static_vectors];
     env->sregs[LITBASE] &= ~1;
+#ifdef CONFIG_USER_ONLY
+    /* Same PS as the Linux kernel gives a new user thread,
+     * with PS.CALLINC set up for the entry at the program start.
+     * The kernel enables coprocessors lazily on first use, user mode
+     * just keeps them all enabled.
+     */
+    env->sregs[PS] = PS_UM | (1 << PS_RING_SHIFT);
+    if (xtensa_option_enabled(env->config, XTENSA_OPTION_WINDOWED_REGISTER)) {
+        env->sregs[PS] |= PS_WOE | (1 << PS_CALLINC_SHIFT);
+    }
+    env->sregs[CPENABLE] = 0xff;
+#else
     env->sregs[PS] = xtensa_option_enabled(env->config,
             XTENSA_OPTION_INTERRUPT) ? 0x1f : 0x10;
+#endif
     env->sregs[VECBASE] = env->config->vecbase;
     env->sregs[IBREAKENABLE] = 0;
     env->sregs[MEMCTL] = MEMCTL_IL0EN & env->config->memctl_mask;
@@ -104,11 +141,12 @@ static void xtensa_cpu_disas_set_info(CPUState *cs, disassemble_info *info)
 static void xtensa_cpu_realizefn(DeviceState *dev, Error **errp)
 {
     CPUState *cs = CPU(dev);
-    XtensaCPU *cpu = XTENSA_CPU(dev);
     XtensaCPUClass *xcc = XTENSA_CPU_GET_CLASS(dev);
     Error *local_err = NULL;
 
-    xtensa_irq_init(&cpu->env);
+#ifndef CONFIG_USER_ONLY
+    xtensa_irq_init(&XTENSA_CPU(dev)->env);
+#endif
 
     cpu_exec_realizefn(cs, &local_err);
     if (local_err != NULL) {
@@ -132,12 +170,15 @@ static void xtensa_cpu_initfn(Object *obj)
 
     cs->env_ptr = env;
     env->config = xcc->config;
+    env->regs = env->phys_regs;
 
+#ifndef CONFIG_USER_ONLY
     env->address_space_er = g_malloc(sizeof(*env->address_space_er));
     env->system_er = g_malloc(sizeof(*env->system_er));
     memory_region_init_io(env->system_er, NULL, NULL, env, "er",
                           UINT64_C(0x100000000));
     address_space_init(env->address_space_er, env->system_er, "ER");
+#endif
 }
 
 static const VMStateDescription vmstate_xtensa_cpu = {
@@ -145,6 +186,17 @@ static const VMStateDescription vmstate_xtensa_cpu = {
     .unmigratable = 1,
 };
 
+static Property xtensa_cpu_properties[] = {
+#ifndef CONFIG_USER_ONLY
+    DEFINE_PROP_BOOL("semihosting-async", XtensaCPU,
+                     env.semihosting_async, false),
+    DEFINE_PROP_BOOL("ccount-insns", XtensaCPU, env.ccount_insns, false),
+#endif
+    DEFINE_PROP_BOOL("fold-l32r", XtensaCPU, env.fold_l32r, false),
+    DEFINE_PROP_BOOL("follow-jumps", XtensaCPU, env.follow_jumps, true),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void xtensa_cpu_class_init(ObjectClass *oc, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(oc);
@@ -166,7 +218,10 @@ static void xtensa_cpu_class_init(ObjectClass *oc, void *data)
     cc->gdb_read_register = xtensa_cpu_gdb_read_register;
     cc->gdb_write_register = xtensa_cpu_gdb_write_register;
     cc->gdb_stop_before_watchpoint = true;
-#ifndef CONFIG_USER_ONLY
+#ifdef CONFIG_USER_ONLY
+    cc->handle_mmu_fault = xtensa_cpu_handle_mmu_fault;
+#else
+    cc->cpu_exec_enter = xtensa_cpu_exec_enter;
     cc->do_unaligned_access = xtensa_cpu_do_unaligned_access;
     cc->get_phys_page_debug = xtensa_cpu_get_phys_page_debug;
     cc->do_unassigned_access = xtensa_cpu_do_unassigned_access;
@@ -175,6 +230,7 @@ static void xtensa_cpu_class_init(ObjectClass *oc, void *data)
     cc->disas_set_info = xtensa_cpu_disas_set_info;
     cc->tcg_initialize = xtensa_translate_init;
     dc->vmsd = &vmstate_xtensa_cpu;
+    dc->props = xtensa_cpu_properties;
 }
 
 static const TypeInfo xtensa_cpu_type_info = {
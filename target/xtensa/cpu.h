@@ -31,6 +31,12 @@
 #define ALIGNED_ONLY
 #define TARGET_LONG_BITS 32
 
+/* Xtensa processors have a weak memory model */
+#define TCG_GUEST_DEFAULT_MO      (0)
+
+/* Ring 1 address spaces kept in the softmmu TLB across RASID writes */
+#define CPU_TLB_ASID_SLOTS 4
+
 #define CPUArchState struct CPUXtensaState
 
 #include "qemu-common.h"
@@ -39,6 +45,7 @@
 #include "xtensa-isa.h"
 
 #define NB_MMU_MODES 4
+#define TARGET_INSN_START_EXTRA_WORDS 1
 
 #define TARGET_PHYS_ADDR_SPACE_BITS 32
 #define TARGET_VIRT_ADDR_SPACE_BITS 32
@@ -173,6 +180,7 @@ enum {
 
 #define PS_OWB 0xf00
 #define PS_OWB_SHIFT 8
+#define PS_OWB_LEN 4
 
 #define PS_CALLINC 0x30000
 #define PS_CALLINC_SHIFT 16
@@ -301,6 +309,34 @@ typedef struct xtensa_tlb_entry {
     bool variable;
 } xtensa_tlb_entry;
 
+/*
+ * Result of a successful single-hit TLB lookup for a page, valid for
+ * the RASID and TLBCFG values it was made with.
+ */
+typedef struct xtensa_tlb_lookup_cache_entry {
+    uint32_t vaddr;
+    uint32_t rasid;
+    uint32_t tlbcfg;
+    uint8_t wi;
+    uint8_t ei;
+    uint8_t ring;
+} xtensa_tlb_lookup_cache_entry;
+
+#define XTENSA_TLB_LOOKUP_CACHE_SIZE 256
+
+/*
+ * Physical address of a page table page used by autorefill, valid for
+ * the RASID and DTLBCFG values it was translated with.
+ */
+typedef struct xtensa_pte_cache_entry {
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t rasid;
+    uint32_t tlbcfg;
+} xtensa_pte_cache_entry;
+
+#define XTENSA_PTE_CACHE_SIZE 8
+
 typedef struct xtensa_tlb {
     unsigned nways;
     const unsigned way_size[10];
@@ -350,6 +386,23 @@ typedef struct XtensaOpcodeTranslators {
     const XtensaOpcodeOps *opcode;
 } XtensaOpcodeTranslators;
 
+/*
+ * Decoded single-slot instruction, looked up by its raw bytes to skip
+ * libisa decoding when the same instruction is translated again.
+ */
+typedef struct XtensaDecodedInsn {
+    uint64_t insn;
+    unsigned len;
+    xtensa_opcode opc;
+    XtensaOpcodeOps *ops;
+    unsigned nargs;
+    uint32_t pcrel;
+    uint8_t opnd[MAX_OPCODE_ARGS];
+    uint32_t raw_arg[MAX_OPCODE_ARGS];
+} XtensaDecodedInsn;
+
+#define XTENSA_DECODE_CACHE_BITS 12
+
 extern const XtensaOpcodeTranslators xtensa_core_opcodes;
 extern const XtensaOpcodeTranslators xtensa_fpu2000_opcodes;
 
@@ -397,6 +450,7 @@ struct XtensaConfig {
     xtensa_isa isa;
     XtensaOpcodeOps **opcode_ops;
     const XtensaOpcodeTranslators **opcode_translators;
+    XtensaDecodedInsn *decode_cache;
 
     uint32_t clock_freq_khz;
 
@@ -423,11 +477,16 @@ enum {
 
 typedef struct CPUXtensaState {
     const XtensaConfig *config;
-    uint32_t regs[16];
+    uint32_t *regs; /* current register window, points into phys_regs */
     uint32_t pc;
     uint32_t sregs[256];
     uint32_t uregs[256];
-    uint32_t phys_regs[MAX_NAREG];
+    /*
+     * Physical AR registers. When the current window wraps around the
+     * end of the register file its tail lives past nareg, see
+     * xtensa_sync_window_from_phys.
+     */
+    uint32_t phys_regs[MAX_NAREG + 12];
     union {
         float32 f32[2];
         float64 f64;
@@ -436,6 +495,9 @@ typedef struct CPUXtensaState {
 
     xtensa_tlb_entry itlb[7][MAX_TLB_WAY_SIZE];
     xtensa_tlb_entry dtlb[10][MAX_TLB_WAY_SIZE];
+    xtensa_tlb_lookup_cache_entry itlb_lookup[XTENSA_TLB_LOOKUP_CACHE_SIZE];
+    xtensa_tlb_lookup_cache_entry dtlb_lookup[XTENSA_TLB_LOOKUP_CACHE_SIZE];
+    xtensa_pte_cache_entry pte_cache[XTENSA_PTE_CACHE_SIZE];
     unsigned autorefill_idx;
     bool runstall;
     AddressSpace *address_space_er;
@@ -447,10 +509,39 @@ typedef struct CPUXtensaState {
     uint64_t ccount_time;
     uint32_t ccount_base;
 
+    /*
+     * CCOUNT advances by one per executed instruction instead of
+     * following QEMU_CLOCK_VIRTUAL. While running, CCOUNT equals
+     * ccount_deadline - ccount_budget; the budget runs out at the nearest
+     * CCOMPARE match. ccount_sync is the CCOUNT value the budget was
+     * computed from, ccount_halted is set while waiti sleeps on the
+     * virtual clock.
+     */
+    bool ccount_insns;
+    bool ccount_halted;
+    uint32_t ccount_sync;
+    uint32_t ccount_deadline;
+    int32_t ccount_budget;
+
     int exception_taken;
     int yield_needed;
     unsigned static_vectors;
 
+    /* Run blocking semihosting calls in a worker thread */
+    bool semihosting_async;
+    /* The CPU is halted until its semihosting call completes */
+    bool semihosting_pending;
+
+    /*
+     * Fold L32R literals from the TB page and from instruction/data ROM
+     * into immediates at translation time.
+     */
+    bool fold_l32r;
+    /* Watchpoints were set when TBs were last flushed for fold_l32r */
+    bool fold_l32r_watch;
+    /* Continue translation across forward jumps and calls within a page */
+    bool follow_jumps;
+
     /* Watchpoints for DBREAK registers */
     struct CPUWatchpoint *cpu_watchpoint[MAX_NDBREAK];
 
@@ -488,6 +579,8 @@ void xtensa_cpu_do_unassigned_access(CPUState *cpu, hwaddr addr,
 void xtensa_cpu_dump_state(CPUState *cpu, FILE *f,
                            fprintf_function cpu_fprintf, int flags);
 hwaddr xtensa_cpu_get_phys_page_debug(CPUState *cpu, vaddr addr);
+int xtensa_cpu_handle_mmu_fault(CPUState *cs, vaddr address, int size,
+                                int rw, int mmu_idx);
 int xtensa_cpu_gdb_read_register(CPUState *cpu, uint8_t *buf, int reg);
 int xtensa_cpu_gdb_write_register(CPUState *cpu, uint8_t *buf, int reg);
 void xtensa_cpu_do_unaligned_access(CPUState *cpu, vaddr addr,
@@ -519,18 +612,32 @@ void xtensa_breakpoint_handler(CPUState *cs);
 void xtensa_finalize_config(XtensaConfig *config);
 void xtensa_register_core(XtensaConfigList *node);
 void xtensa_sim_open_console(Chardev *chr);
+int xtensa_get_pending_irq_level(CPUXtensaState *env);
 void check_interrupts(CPUXtensaState *s);
+void check_interrupts_local(CPUXtensaState *env);
+void xtensa_fold_l32r_check_watchpoints(CPUXtensaState *env);
 void xtensa_irq_init(CPUXtensaState *env);
 void *xtensa_get_extint(CPUXtensaState *env, unsigned extint);
+void **xtensa_get_extints(CPUXtensaState *env);
+void *xtensa_get_runstall(CPUXtensaState *env);
 void xtensa_timer_irq(CPUXtensaState *env, uint32_t id, uint32_t active);
+uint32_t xtensa_ccount_insns_get(CPUXtensaState *env);
+void xtensa_ccount_insns_set(CPUXtensaState *env, uint32_t v);
+void xtensa_ccount_insns_advance(CPUXtensaState *env, uint32_t v);
+void xtensa_ccount_insns_halt(CPUXtensaState *env);
+void xtensa_ccount_insns_resume(CPUXtensaState *env);
 int cpu_xtensa_signal_handler(int host_signum, void *pinfo, void *puc);
 void xtensa_cpu_list(FILE *f, fprintf_function cpu_fprintf);
 void xtensa_sync_window_from_phys(CPUXtensaState *env);
 void xtensa_sync_phys_from_window(CPUXtensaState *env);
+void xtensa_rotate_window(CPUXtensaState *env, uint32_t delta);
+void xtensa_restore_owb(CPUXtensaState *env);
 uint32_t xtensa_tlb_get_addr_mask(const CPUXtensaState *env, bool dtlb, uint32_t way);
 void split_tlb_entry_spec_way(const CPUXtensaState *env, uint32_t v, bool dtlb,
         uint32_t *vpn, uint32_t wi, uint32_t *ei);
-int xtensa_tlb_lookup(const CPUXtensaState *env, uint32_t addr, bool dtlb,
+void xtensa_tlb_lookup_cache_flush(CPUXtensaState *env, bool dtlb,
+                                   unsigned wi, uint32_t vaddr);
+int xtensa_tlb_lookup(CPUXtensaState *env, uint32_t addr, bool dtlb,
         uint32_t *pwi, uint32_t *pei, uint8_t *pring);
 void xtensa_tlb_set_entry_mmu(const CPUXtensaState *env,
         xtensa_tlb_entry *entry, bool dtlb,
@@ -619,6 +726,7 @@ static inline uint32_t xtensa_replicate_windowstart(CPUXtensaState *env)
 #define MMU_MODE1_SUFFIX _ring1
 #define MMU_MODE2_SUFFIX _ring2
 #define MMU_MODE3_SUFFIX _ring3
+#define MMU_USER_IDX 1
 
 static inline int cpu_mmu_index(CPUXtensaState *env, bool ifetch)
 {
@@ -630,12 +738,21 @@ static inline int cpu_mmu_index(CPUXtensaState *env, bool ifetch)
 #define XTENSA_TBFLAG_LITBASE 0x8
 #define XTENSA_TBFLAG_DEBUG 0x10
 #define XTENSA_TBFLAG_ICOUNT 0x20
-#define XTENSA_TBFLAG_CPENABLE_MASK 0x3fc0
-#define XTENSA_TBFLAG_CPENABLE_SHIFT 6
 #define XTENSA_TBFLAG_EXCEPTION 0x4000
-#define XTENSA_TBFLAG_WINDOW_MASK 0x18000
-#define XTENSA_TBFLAG_WINDOW_SHIFT 15
+#define XTENSA_TBFLAG_WINDOW_CHECK 0x8000
 #define XTENSA_TBFLAG_YIELD 0x20000
+#define XTENSA_TBFLAG_ICOUNT_BATCH 0x40000
+
+/*
+ * ICOUNT is accounted once per TB when it is at least this far from
+ * overflow; must not be less than the TB size limit.
+ */
+#define XTENSA_ICOUNT_BATCH_MAX 512
+
+#define XTENSA_CSBASE_LEND_MASK 0x0000ffff
+#define XTENSA_CSBASE_LEND_SHIFT 0
+#define XTENSA_CSBASE_LBEG_OFF_MASK 0x00ff0000
+#define XTENSA_CSBASE_LBEG_OFF_SHIFT 16
 
 static inline void cpu_get_tb_cpu_state(CPUXtensaState *env, target_ulong *pc,
         target_ulong *cs_base, uint32_t *flags)
@@ -649,6 +766,29 @@ static inline void cpu_get_tb_cpu_state(CPUXtensaState *env, target_ulong *pc,
     if (env->sregs[PS] & PS_EXCM) {
         *flags |= XTENSA_TBFLAG_EXCM;
     }
+    if (xtensa_option_enabled(env->config, XTENSA_OPTION_LOOP) &&
+            !(env->sregs[PS] & PS_EXCM)) {
+        target_ulong lend_dist =
+            env->sregs[LEND] - (env->pc & -(1u << TARGET_PAGE_BITS));
+
+        /*
+         * Zero in the LEND field of cs_base means that no instruction
+         * starting in this page may end at LEND, so the TB needs no
+         * loopback code. Otherwise it is the offset of LEND from the page
+         * start; instructions crossing the page boundary make it exceed
+         * the page size a bit. LBEG is recorded as a short backwards
+         * offset from LEND when possible, so that the loopback becomes a
+         * direct jump.
+         */
+        if (lend_dist < (1u << TARGET_PAGE_BITS) + MAX_INSN_LENGTH) {
+            target_ulong lbeg_off = env->sregs[LEND] - env->sregs[LBEG];
+
+            *cs_base = lend_dist << XTENSA_CSBASE_LEND_SHIFT;
+            if (lbeg_off < 256) {
+                *cs_base |= lbeg_off << XTENSA_CSBASE_LBEG_OFF_SHIFT;
+            }
+        }
+    }
     if (xtensa_option_enabled(env->config, XTENSA_OPTION_EXTENDED_L32R) &&
             (env->sregs[LITBASE] & 1)) {
         *flags |= XTENSA_TBFLAG_LITBASE;
@@ -659,23 +799,18 @@ static inline void cpu_get_tb_cpu_state(CPUXtensaState *env, target_ulong *pc,
         }
         if (xtensa_get_cintlevel(env) < env->sregs[ICOUNTLEVEL]) {
             *flags |= XTENSA_TBFLAG_ICOUNT;
+            if (env->sregs[ICOUNT] < (uint32_t)-XTENSA_ICOUNT_BATCH_MAX &&
+                !cs->singlestep_enabled) {
+                *flags |= XTENSA_TBFLAG_ICOUNT_BATCH;
+            }
         }
     }
-    if (xtensa_option_enabled(env->config, XTENSA_OPTION_COPROCESSOR)) {
-        *flags |= env->sregs[CPENABLE] << XTENSA_TBFLAG_CPENABLE_SHIFT;
-    }
     if (cs->singlestep_enabled && env->exception_taken) {
         *flags |= XTENSA_TBFLAG_EXCEPTION;
     }
     if (xtensa_option_enabled(env->config, XTENSA_OPTION_WINDOWED_REGISTER) &&
         (env->sregs[PS] & (PS_WOE | PS_EXCM)) == PS_WOE) {
-        uint32_t windowstart = xtensa_replicate_windowstart(env) >>
-            (env->sregs[WINDOW_BASE] + 1);
-        uint32_t w = ctz32(windowstart | 0x8);
-
-        *flags |= w << XTENSA_TBFLAG_WINDOW_SHIFT;
-    } else {
-        *flags |= 3 << XTENSA_TBFLAG_WINDOW_SHIFT;
+        *flags |= XTENSA_TBFLAG_WINDOW_CHECK;
     }
     if (env->yield_needed) {
         *flags |= XTENSA_TBFLAG_YIELD;
@@ -29,6 +29,7 @@
 #include "cpu.h"
 #include "exec/exec-all.h"
 #include "exec/gdbstub.h"
+#include "exec/cpu_ldst.h"
 #include "qemu/host-utils.h"
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/loader.h"
@@ -61,6 +62,8 @@ static void init_libisa(XtensaConfig *config)
     assert(xtensa_isa_maxlength(config->isa) <= MAX_INSN_LENGTH);
     opcodes = xtensa_isa_num_opcodes(config->isa);
     config->opcode_ops = g_new(XtensaOpcodeOps *, opcodes);
+    config->decode_cache = g_new0(XtensaDecodedInsn,
+                                  1 << XTENSA_DECODE_CACHE_BITS);
 
     for (i = 0; i < opcodes; ++i) {
         const char *opc_name = xtensa_opcode_name(config->isa, i);
@@ -150,6 +153,21 @@ void xtensa_breakpoint_handler(CPUState *cs)
     }
 }
 
+/*
+ * TBs translated while there were no watchpoints may have L32R literals
+ * folded, flush them when the first watchpoint appears.
+ */
+void xtensa_fold_l32r_check_watchpoints(CPUXtensaState *env)
+{
+    CPUState *cs = CPU(xtensa_env_get_cpu(env));
+    bool watch = !QTAILQ_EMPTY(&cs->watchpoints);
+
+    if (env->fold_l32r && watch && !env->fold_l32r_watch) {
+        tb_flush(cs);
+    }
+    env->fold_l32r_watch = watch;
+}
+
 void xtensa_cpu_list(FILE *f, fprintf_function cpu_fprintf)
 {
     XtensaConfigList *core = xtensa_cores;
@@ -159,6 +177,29 @@ void xtensa_cpu_list(FILE *f, fprintf_function cpu_fprintf)
     }
 }
 
+#ifdef CONFIG_USER_ONLY
+
+int xtensa_cpu_handle_mmu_fault(CPUState *cs, vaddr address, int size, int rw,
+                                int mmu_idx)
+{
+    XtensaCPU *cpu = XTENSA_CPU(cs);
+    CPUXtensaState *env = &cpu->env;
+
+    qemu_log_mask(CPU_LOG_INT,
+                  "%s: rw = %d, address = 0x%08" VADDR_PRIx ", size = %d\n",
+                  __func__, rw, address, size);
+    env->sregs[EXCVADDR] = address;
+    env->sregs[EXCCAUSE] = rw ? STORE_PROHIBITED_CAUSE : LOAD_PROHIBITED_CAUSE;
+    cs->exception_index = EXC_USER;
+    return 1;
+}
+
+void xtensa_cpu_do_interrupt(CPUState *cs)
+{
+}
+
+#else
+
 hwaddr xtensa_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
 {
     XtensaCPU *cpu = XTENSA_CPU(cs);
@@ -287,6 +328,8 @@ void xtensa_cpu_do_interrupt(CPUState *cs)
     check_interrupts(env);
 }
 
+#endif
+
 bool xtensa_cpu_exec_interrupt(CPUState *cs, int interrupt_request)
 {
     if (interrupt_request & CPU_INTERRUPT_HARD) {
@@ -371,6 +414,56 @@ static void reset_tlb_region_way0(CPUXtensaState *env,
     }
 }
 
+static xtensa_tlb_lookup_cache_entry *
+tlb_lookup_cache_entry(CPUXtensaState *env, uint32_t addr, bool dtlb)
+{
+    return (dtlb ? env->dtlb_lookup : env->itlb_lookup) +
+        ((addr >> TARGET_PAGE_BITS) & (XTENSA_TLB_LOOKUP_CACHE_SIZE - 1));
+}
+
+static xtensa_pte_cache_entry *pte_cache_entry(CPUXtensaState *env,
+                                               uint32_t addr)
+{
+    return env->pte_cache +
+        ((addr >> TARGET_PAGE_BITS) & (XTENSA_PTE_CACHE_SIZE - 1));
+}
+
+static void tlb_lookup_cache_flush_all(CPUXtensaState *env, bool dtlb)
+{
+    xtensa_tlb_lookup_cache_entry *cache = dtlb ?
+        env->dtlb_lookup : env->itlb_lookup;
+    unsigned i;
+
+    for (i = 0; i < XTENSA_TLB_LOOKUP_CACHE_SIZE; ++i) {
+        cache[i].vaddr = 1;
+    }
+    if (dtlb) {
+        for (i = 0; i < XTENSA_PTE_CACHE_SIZE; ++i) {
+            env->pte_cache[i].vaddr = 1;
+        }
+    }
+}
+
+/*!
+ * Drop cached lookup results and, for the DTLB, cached page table page
+ * translations that may be affected by a change of the entry at vaddr
+ * in the way wi. Ways 0..3 always map 4KB pages, so only one page is
+ * affected. Page size of the other ways depends on TLBCFG, which is only
+ * a tag of cached results, so flush everything for them.
+ */
+void xtensa_tlb_lookup_cache_flush(CPUXtensaState *env, bool dtlb,
+                                   unsigned wi, uint32_t vaddr)
+{
+    if (wi < 4) {
+        tlb_lookup_cache_entry(env, vaddr, dtlb)->vaddr = 1;
+        if (dtlb) {
+            pte_cache_entry(env, vaddr)->vaddr = 1;
+        }
+    } else {
+        tlb_lookup_cache_flush_all(env, dtlb);
+    }
+}
+
 void reset_mmu(CPUXtensaState *env)
 {
     if (xtensa_option_enabled(env->config, XTENSA_OPTION_MMU)) {
@@ -378,6 +471,8 @@ void reset_mmu(CPUXtensaState *env)
         env->sregs[ITLBCFG] = 0;
         env->sregs[DTLBCFG] = 0;
         env->autorefill_idx = 0;
+        tlb_lookup_cache_flush_all(env, false);
+        tlb_lookup_cache_flush_all(env, true);
         reset_tlb_mmu_all_ways(env, &env->config->itlb, env->itlb);
         reset_tlb_mmu_all_ways(env, &env->config->dtlb, env->dtlb);
         reset_tlb_mmu_ways56(env, &env->config->itlb, env->itlb);
@@ -403,22 +498,40 @@ static unsigned get_ring(const CPUXtensaState *env, uint8_t asid)
  * Lookup xtensa TLB for the given virtual address.
  * See ISA, 4.6.2.2
  *
+ * Single hits are remembered per page in a lookup cache tagged with
+ * RASID and TLBCFG; any change to the TLB entries flushes affected pages
+ * from it, so a cached hit is never a hidden multi-hit.
+ *
  * \param pwi: [out] way index
  * \param pei: [out] entry index
  * \param pring: [out] access ring
  * \return 0 if ok, exception cause code otherwise
  */
-int xtensa_tlb_lookup(const CPUXtensaState *env, uint32_t addr, bool dtlb,
+int xtensa_tlb_lookup(CPUXtensaState *env, uint32_t addr, bool dtlb,
         uint32_t *pwi, uint32_t *pei, uint8_t *pring)
 {
     const xtensa_tlb *tlb = dtlb ?
         &env->config->dtlb : &env->config->itlb;
     const xtensa_tlb_entry (*entry)[MAX_TLB_WAY_SIZE] = dtlb ?
         env->dtlb : env->itlb;
+    xtensa_tlb_lookup_cache_entry *cached = NULL;
+    uint32_t tlbcfg = env->sregs[dtlb ? DTLBCFG : ITLBCFG];
 
     int nhits = 0;
     unsigned wi;
 
+    if (xtensa_option_enabled(env->config, XTENSA_OPTION_MMU)) {
+        cached = tlb_lookup_cache_entry(env, addr, dtlb);
+        if (cached->vaddr == (addr & TARGET_PAGE_MASK) &&
+            cached->rasid == env->sregs[RASID] &&
+            cached->tlbcfg == tlbcfg) {
+            *pwi = cached->wi;
+            *pei = cached->ei;
+            *pring = cached->ring;
+            return 0;
+        }
+    }
+
     for (wi = 0; wi < tlb->nways; ++wi) {
         uint32_t vpn;
         uint32_t ei;
@@ -437,6 +550,14 @@ int xtensa_tlb_lookup(const CPUXtensaState *env, uint32_t addr, bool dtlb,
             }
         }
     }
+    if (nhits && cached) {
+        cached->vaddr = addr & TARGET_PAGE_MASK;
+        cached->rasid = env->sregs[RASID];
+        cached->tlbcfg = tlbcfg;
+        cached->wi = *pwi;
+        cached->ei = *pei;
+        cached->ring = *pring;
+    }
     return nhits ? 0 :
         (dtlb ? LOAD_STORE_TLB_MISS_CAUSE : INST_TLB_MISS_CAUSE);
 }
@@ -598,20 +719,38 @@ static int get_physical_addr_mmu(CPUXtensaState *env, bool update_tlb,
 
 static int get_pte(CPUXtensaState *env, uint32_t vaddr, uint32_t *pte)
 {
-    CPUState *cs = CPU(xtensa_env_get_cpu(env));
     uint32_t paddr;
     uint32_t page_size;
     unsigned access;
     uint32_t pt_vaddr =
         (env->sregs[PTEVADDR] | (vaddr >> 10)) & 0xfffffffc;
-    int ret = get_physical_addr_mmu(env, false, pt_vaddr, 0, 0,
-            &paddr, &page_size, &access, false);
+    xtensa_pte_cache_entry *cached = pte_cache_entry(env, pt_vaddr);
+    int ret = 0;
+
+    if (cached->vaddr == (pt_vaddr & TARGET_PAGE_MASK) &&
+        cached->rasid == env->sregs[RASID] &&
+        cached->tlbcfg == env->sregs[DTLBCFG]) {
+        paddr = cached->paddr | (pt_vaddr & ~TARGET_PAGE_MASK);
+    } else {
+        ret = get_physical_addr_mmu(env, false, pt_vaddr, 0, 0,
+                                    &paddr, &page_size, &access, false);
+        if (ret == 0) {
+            cached->vaddr = pt_vaddr & TARGET_PAGE_MASK;
+            cached->paddr = paddr & TARGET_PAGE_MASK;
+            cached->rasid = env->sregs[RASID];
+            cached->tlbcfg = env->sregs[DTLBCFG];
+        }
+    }
 
     qemu_log_mask(CPU_LOG_MMU, "%s: trying autorefill(%08x) -> %08x\n",
                   __func__, vaddr, ret ? ~0 : paddr);
 
     if (ret == 0) {
-        *pte = ldl_phys(cs->as, paddr);
+#ifdef CONFIG_USER_ONLY
+        *pte = cpu_ldl_data(env, paddr);
+#else
+        *pte = ldl_phys(CPU(xtensa_env_get_cpu(env))->as, paddr);
+#endif
     }
     return ret;
 }
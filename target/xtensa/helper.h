@@ -10,16 +10,20 @@ DEF_HELPER_2(rotw, void, env, i32)
 DEF_HELPER_3(window_check, noreturn, env, i32, i32)
 DEF_HELPER_1(restore_owb, void, env)
 DEF_HELPER_2(movsp, void, env, i32)
-DEF_HELPER_2(wsr_lbeg, void, env, i32)
-DEF_HELPER_2(wsr_lend, void, env, i32)
+#ifndef CONFIG_USER_ONLY
 DEF_HELPER_1(simcall, void, env)
+#endif
 DEF_HELPER_1(dump_state, void, env)
 
 DEF_HELPER_3(waiti, void, env, i32, i32)
 DEF_HELPER_1(update_ccount, void, env)
 DEF_HELPER_2(wsr_ccount, void, env, i32)
 DEF_HELPER_2(update_ccompare, void, env, i32)
+DEF_HELPER_2(wsr_ccompare, void, env, i32)
+DEF_HELPER_1(ccount_expired, void, env)
 DEF_HELPER_1(check_interrupts, void, env)
+DEF_HELPER_2(intset, void, env, i32)
+DEF_HELPER_2(intclear, void, env, i32)
 DEF_HELPER_3(check_atomctl, void, env, i32, i32)
 DEF_HELPER_2(wsr_memctl, void, env, i32)
 
@@ -39,23 +43,23 @@ DEF_HELPER_3(wsr_dbreakc, void, env, i32, i32)
 DEF_HELPER_2(wur_fcr, void, env, i32)
 DEF_HELPER_FLAGS_1(abs_s, TCG_CALL_NO_RWG_SE, f32, f32)
 DEF_HELPER_FLAGS_1(neg_s, TCG_CALL_NO_RWG_SE, f32, f32)
-DEF_HELPER_3(add_s, f32, env, f32, f32)
-DEF_HELPER_3(sub_s, f32, env, f32, f32)
-DEF_HELPER_3(mul_s, f32, env, f32, f32)
-DEF_HELPER_4(madd_s, f32, env, f32, f32, f32)
-DEF_HELPER_4(msub_s, f32, env, f32, f32, f32)
+DEF_HELPER_FLAGS_3(add_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_3(sub_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_3(mul_s, TCG_CALL_NO_RWG, f32, env, f32, f32)
+DEF_HELPER_FLAGS_4(madd_s, TCG_CALL_NO_RWG, f32, env, f32, f32, f32)
+DEF_HELPER_FLAGS_4(msub_s, TCG_CALL_NO_RWG, f32, env, f32, f32, f32)
 DEF_HELPER_FLAGS_3(ftoi, TCG_CALL_NO_RWG_SE, i32, f32, i32, i32)
 DEF_HELPER_FLAGS_3(ftoui, TCG_CALL_NO_RWG_SE, i32, f32, i32, i32)
-DEF_HELPER_3(itof, f32, env, i32, i32)
-DEF_HELPER_3(uitof, f32, env, i32, i32)
+DEF_HELPER_FLAGS_3(itof, TCG_CALL_NO_RWG, f32, env, i32, i32)
+DEF_HELPER_FLAGS_3(uitof, TCG_CALL_NO_RWG, f32, env, i32, i32)
 
-DEF_HELPER_4(un_s, void, env, i32, f32, f32)
-DEF_HELPER_4(oeq_s, void, env, i32, f32, f32)
-DEF_HELPER_4(ueq_s, void, env, i32, f32, f32)
-DEF_HELPER_4(olt_s, void, env, i32, f32, f32)
-DEF_HELPER_4(ult_s, void, env, i32, f32, f32)
-DEF_HELPER_4(ole_s, void, env, i32, f32, f32)
-DEF_HELPER_4(ule_s, void, env, i32, f32, f32)
+DEF_HELPER_FLAGS_3(un_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(oeq_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ueq_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(olt_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ult_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ole_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
+DEF_HELPER_FLAGS_3(ule_s, TCG_CALL_NO_RWG, i32, env, f32, f32)
 
 DEF_HELPER_2(rer, i32, env, i32)
 DEF_HELPER_3(wer, void, env, i32, i32)
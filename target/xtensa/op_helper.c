@@ -35,6 +35,18 @@
 #include "exec/address-spaces.h"
 #include "qemu/timer.h"
 #include "fpu/softfloat.h"
+#include <float.h>
+#include <math.h>
+#ifdef CONFIG_USER_ONLY
+#include "translate-all.h"
+#endif
+
+static void QEMU_NORETURN exception_cause_vaddr_ra(CPUXtensaState *env,
+                                                   uint32_t pc, uint32_t cause,
+                                                   uint32_t vaddr,
+                                                   uintptr_t retaddr);
+
+#ifndef CONFIG_USER_ONLY
 
 void xtensa_cpu_do_unaligned_access(CPUState *cs,
         vaddr addr, MMUAccessType access_type,
@@ -46,8 +58,8 @@ void xtensa_cpu_do_unaligned_access(CPUState *cs,
     if (xtensa_option_enabled(env->config, XTENSA_OPTION_UNALIGNED_EXCEPTION) &&
             !xtensa_option_enabled(env->config, XTENSA_OPTION_HW_ALIGNMENT)) {
         cpu_restore_state(CPU(cpu), retaddr);
-        HELPER(exception_cause_vaddr)(env,
-                env->pc, LOAD_STORE_ALIGNMENT_CAUSE, addr);
+        exception_cause_vaddr_ra(env, env->pc, LOAD_STORE_ALIGNMENT_CAUSE,
+                                 addr, 0);
     }
 }
 
@@ -72,7 +84,7 @@ void tlb_fill(CPUState *cs, target_ulong vaddr, int size,
                      access, mmu_idx, page_size);
     } else {
         cpu_restore_state(cs, retaddr);
-        HELPER(exception_cause_vaddr)(env, env->pc, ret, vaddr);
+        exception_cause_vaddr_ra(env, env->pc, ret, vaddr, 0);
     }
 }
 
@@ -83,15 +95,24 @@ void xtensa_cpu_do_unassigned_access(CPUState *cs, hwaddr addr,
     XtensaCPU *cpu = XTENSA_CPU(cs);
     CPUXtensaState *env = &cpu->env;
 
-    HELPER(exception_cause_vaddr)(env, env->pc,
-                                  is_exec ?
-                                  INSTR_PIF_ADDR_ERROR_CAUSE :
-                                  LOAD_STORE_PIF_ADDR_ERROR_CAUSE,
-                                  is_exec ? addr : cs->mem_io_vaddr);
+    exception_cause_vaddr_ra(env, env->pc,
+                             is_exec ?
+                             INSTR_PIF_ADDR_ERROR_CAUSE :
+                             LOAD_STORE_PIF_ADDR_ERROR_CAUSE,
+                             is_exec ? addr : cs->mem_io_vaddr, 0);
 }
 
+#endif
+
 static void tb_invalidate_virtual_addr(CPUXtensaState *env, uint32_t vaddr)
 {
+#ifdef CONFIG_USER_ONLY
+    mmap_lock();
+    tb_lock();
+    tb_invalidate_phys_page_range(vaddr, vaddr + 1, 0);
+    tb_unlock();
+    mmap_unlock();
+#else
     uint32_t paddr;
     uint32_t page_size;
     unsigned access;
@@ -100,9 +121,28 @@ static void tb_invalidate_virtual_addr(CPUXtensaState *env, uint32_t vaddr)
     if (ret == 0) {
         tb_invalidate_phys_addr(&address_space_memory, paddr);
     }
+#endif
 }
 
-void HELPER(exception)(CPUXtensaState *env, uint32_t excp)
+/*
+ * TBs that account ICOUNT or CCOUNT for all their instructions at entry
+ * must be rolled back to the instruction that raised an exception, so
+ * that the instructions after it are not counted. Other TBs don't need
+ * that, the caller sets the PC anyway.
+ * Must be called before the exception changes PS.
+ */
+static uintptr_t exception_retaddr(const CPUXtensaState *env,
+                                   uintptr_t retaddr)
+{
+    if (env->ccount_insns ||
+        xtensa_get_cintlevel(env) < env->sregs[ICOUNTLEVEL]) {
+        return retaddr;
+    }
+    return 0;
+}
+
+static void QEMU_NORETURN exception_ra(CPUXtensaState *env, uint32_t excp,
+                                       uintptr_t retaddr)
 {
     CPUState *cs = CPU(xtensa_env_get_cpu(env));
 
@@ -113,13 +153,21 @@ void HELPER(exception)(CPUXtensaState *env, uint32_t excp)
     if (excp == EXCP_DEBUG) {
         env->exception_taken = 0;
     }
-    cpu_loop_exit(cs);
+    cpu_loop_exit_restore(cs, retaddr);
 }
 
-void HELPER(exception_cause)(CPUXtensaState *env, uint32_t pc, uint32_t cause)
+void HELPER(exception)(CPUXtensaState *env, uint32_t excp)
+{
+    exception_ra(env, excp, 0);
+}
+
+static void QEMU_NORETURN exception_cause_ra(CPUXtensaState *env,
+                                             uint32_t pc, uint32_t cause,
+                                             uintptr_t retaddr)
 {
     uint32_t vector;
 
+    retaddr = exception_retaddr(env, retaddr);
     env->pc = pc;
     if (env->sregs[PS] & PS_EXCM) {
         if (env->config->ndepc) {
@@ -136,68 +184,69 @@ void HELPER(exception_cause)(CPUXtensaState *env, uint32_t pc, uint32_t cause)
     env->sregs[EXCCAUSE] = cause;
     env->sregs[PS] |= PS_EXCM;
 
-    HELPER(exception)(env, vector);
+    exception_ra(env, vector, retaddr);
 }
 
-void HELPER(exception_cause_vaddr)(CPUXtensaState *env,
-        uint32_t pc, uint32_t cause, uint32_t vaddr)
+static void QEMU_NORETURN exception_cause_vaddr_ra(CPUXtensaState *env,
+                                                   uint32_t pc, uint32_t cause,
+                                                   uint32_t vaddr,
+                                                   uintptr_t retaddr)
 {
     env->sregs[EXCVADDR] = vaddr;
-    HELPER(exception_cause)(env, pc, cause);
+    exception_cause_ra(env, pc, cause, retaddr);
 }
 
-void debug_exception_env(CPUXtensaState *env, uint32_t cause)
+void HELPER(exception_cause)(CPUXtensaState *env, uint32_t pc, uint32_t cause)
 {
-    if (xtensa_get_cintlevel(env) < env->config->debug_level) {
-        HELPER(debug_exception)(env, env->pc, cause);
-    }
+    exception_cause_ra(env, pc, cause, GETPC());
 }
 
-void HELPER(debug_exception)(CPUXtensaState *env, uint32_t pc, uint32_t cause)
+void HELPER(exception_cause_vaddr)(CPUXtensaState *env,
+        uint32_t pc, uint32_t cause, uint32_t vaddr)
+{
+    exception_cause_vaddr_ra(env, pc, cause, vaddr, GETPC());
+}
+
+static void QEMU_NORETURN debug_exception_ra(CPUXtensaState *env,
+                                             uint32_t pc, uint32_t cause,
+                                             uintptr_t retaddr)
 {
     unsigned level = env->config->debug_level;
 
+    retaddr = exception_retaddr(env, retaddr);
     env->pc = pc;
     env->sregs[DEBUGCAUSE] = cause;
     env->sregs[EPC1 + level - 1] = pc;
     env->sregs[EPS2 + level - 2] = env->sregs[PS];
     env->sregs[PS] = (env->sregs[PS] & ~PS_INTLEVEL) | PS_EXCM |
         (level << PS_INTLEVEL_SHIFT);
-    HELPER(exception)(env, EXC_DEBUG);
+    exception_ra(env, EXC_DEBUG, retaddr);
 }
 
-static void copy_window_from_phys(CPUXtensaState *env,
-        uint32_t window, uint32_t phys, uint32_t n)
+void debug_exception_env(CPUXtensaState *env, uint32_t cause)
 {
-    assert(phys < env->config->nareg);
-    if (phys + n <= env->config->nareg) {
-        memcpy(env->regs + window, env->phys_regs + phys,
-                n * sizeof(uint32_t));
-    } else {
-        uint32_t n1 = env->config->nareg - phys;
-        memcpy(env->regs + window, env->phys_regs + phys,
-                n1 * sizeof(uint32_t));
-        memcpy(env->regs + window + n1, env->phys_regs,
-                (n - n1) * sizeof(uint32_t));
+    if (xtensa_get_cintlevel(env) < env->config->debug_level) {
+        debug_exception_ra(env, env->pc, cause, 0);
     }
 }
 
-static void copy_phys_from_window(CPUXtensaState *env,
-        uint32_t phys, uint32_t window, uint32_t n)
+void HELPER(debug_exception)(CPUXtensaState *env, uint32_t pc, uint32_t cause)
 {
-    assert(phys < env->config->nareg);
-    if (phys + n <= env->config->nareg) {
-        memcpy(env->phys_regs + phys, env->regs + window,
-                n * sizeof(uint32_t));
-    } else {
-        uint32_t n1 = env->config->nareg - phys;
-        memcpy(env->phys_regs + phys, env->regs + window,
-                n1 * sizeof(uint32_t));
-        memcpy(env->phys_regs, env->regs + window + n1,
-                (n - n1) * sizeof(uint32_t));
-    }
+    debug_exception_ra(env, pc, cause, GETPC());
 }
 
+/*
+ * Number of registers of the current window that don't fit between
+ * WINDOW_BASE * 4 and the end of the physical register file.
+ */
+static uint32_t window_wrap(const CPUXtensaState *env)
+{
+    uint32_t phys = env->sregs[WINDOW_BASE] * 4;
+
+    assert(phys < env->config->nareg);
+    return phys + 16 > env->config->nareg ?
+        phys + 16 - env->config->nareg : 0;
+}
 
 static inline unsigned windowbase_bound(unsigned a, const CPUXtensaState *env)
 {
@@ -209,14 +258,31 @@ static inline unsigned windowstart_bit(unsigned a, const CPUXtensaState *env)
     return 1 << windowbase_bound(a, env);
 }
 
+/*
+ * env->regs points directly into phys_regs at WINDOW_BASE * 4, so a window
+ * rotation only moves the pointer. A window that wraps around the end of
+ * the register file keeps its tail in phys_regs[nareg...] while it is
+ * current; these two functions move that tail in and out of place.
+ */
 void xtensa_sync_window_from_phys(CPUXtensaState *env)
 {
-    copy_window_from_phys(env, 0, env->sregs[WINDOW_BASE] * 4, 16);
+    uint32_t n = window_wrap(env);
+
+    env->regs = env->phys_regs + env->sregs[WINDOW_BASE] * 4;
+    if (n) {
+        memcpy(env->phys_regs + env->config->nareg, env->phys_regs,
+               n * sizeof(uint32_t));
+    }
 }
 
 void xtensa_sync_phys_from_window(CPUXtensaState *env)
 {
-    copy_phys_from_window(env, env->sregs[WINDOW_BASE] * 4, 0, 16);
+    uint32_t n = window_wrap(env);
+
+    if (n) {
+        memcpy(env->phys_regs, env->phys_regs + env->config->nareg,
+               n * sizeof(uint32_t));
+    }
 }
 
 static void rotate_window_abs(CPUXtensaState *env, uint32_t position)
@@ -226,7 +292,7 @@ static void rotate_window_abs(CPUXtensaState *env, uint32_t position)
     xtensa_sync_window_from_phys(env);
 }
 
-static void rotate_window(CPUXtensaState *env, uint32_t delta)
+void xtensa_rotate_window(CPUXtensaState *env, uint32_t delta)
 {
     rotate_window_abs(env, env->sregs[WINDOW_BASE] + delta);
 }
@@ -236,28 +302,8 @@ void HELPER(wsr_windowbase)(CPUXtensaState *env, uint32_t v)
     rotate_window_abs(env, v);
 }
 
-void HELPER(entry)(CPUXtensaState *env, uint32_t pc, uint32_t s, uint32_t imm)
-{
-    int callinc = (env->sregs[PS] & PS_CALLINC) >> PS_CALLINC_SHIFT;
-    if (s > 3 || ((env->sregs[PS] & (PS_WOE | PS_EXCM)) ^ PS_WOE) != 0) {
-        qemu_log_mask(LOG_GUEST_ERROR, "Illegal entry instruction(pc = %08x), PS = %08x\n",
-                      pc, env->sregs[PS]);
-        HELPER(exception_cause)(env, pc, ILLEGAL_INSTRUCTION_CAUSE);
-    } else {
-        uint32_t windowstart = xtensa_replicate_windowstart(env) >>
-            (env->sregs[WINDOW_BASE] + 1);
-
-        if (windowstart & ((1 << callinc) - 1)) {
-            HELPER(window_check)(env, pc, callinc);
-        }
-        env->regs[(callinc << 2) | (s & 3)] = env->regs[s] - imm;
-        rotate_window(env, callinc);
-        env->sregs[WINDOW_START] |=
-            windowstart_bit(env->sregs[WINDOW_BASE], env);
-    }
-}
-
-void HELPER(window_check)(CPUXtensaState *env, uint32_t pc, uint32_t w)
+static void QEMU_NORETURN window_check_ra(CPUXtensaState *env, uint32_t pc,
+                                          uint32_t w, uintptr_t retaddr)
 {
     uint32_t windowbase = windowbase_bound(env->sregs[WINDOW_BASE], env);
     uint32_t windowstart = xtensa_replicate_windowstart(env) >>
@@ -266,21 +312,45 @@ void HELPER(window_check)(CPUXtensaState *env, uint32_t pc, uint32_t w)
 
     assert(n <= w);
 
-    rotate_window(env, n);
+    retaddr = exception_retaddr(env, retaddr);
+    xtensa_rotate_window(env, n);
     env->sregs[PS] = (env->sregs[PS] & ~PS_OWB) |
         (windowbase << PS_OWB_SHIFT) | PS_EXCM;
     env->sregs[EPC1] = env->pc = pc;
 
     switch (ctz32(windowstart >> n)) {
     case 0:
-        HELPER(exception)(env, EXC_WINDOW_OVERFLOW4);
-        break;
+        exception_ra(env, EXC_WINDOW_OVERFLOW4, retaddr);
     case 1:
-        HELPER(exception)(env, EXC_WINDOW_OVERFLOW8);
-        break;
+        exception_ra(env, EXC_WINDOW_OVERFLOW8, retaddr);
     default:
-        HELPER(exception)(env, EXC_WINDOW_OVERFLOW12);
-        break;
+        exception_ra(env, EXC_WINDOW_OVERFLOW12, retaddr);
+    }
+}
+
+void HELPER(window_check)(CPUXtensaState *env, uint32_t pc, uint32_t w)
+{
+    window_check_ra(env, pc, w, GETPC());
+}
+
+void HELPER(entry)(CPUXtensaState *env, uint32_t pc, uint32_t s, uint32_t imm)
+{
+    int callinc = (env->sregs[PS] & PS_CALLINC) >> PS_CALLINC_SHIFT;
+    if (s > 3 || ((env->sregs[PS] & (PS_WOE | PS_EXCM)) ^ PS_WOE) != 0) {
+        qemu_log_mask(LOG_GUEST_ERROR, "Illegal entry instruction(pc = %08x), PS = %08x\n",
+                      pc, env->sregs[PS]);
+        exception_cause_ra(env, pc, ILLEGAL_INSTRUCTION_CAUSE, GETPC());
+    } else {
+        uint32_t windowstart = xtensa_replicate_windowstart(env) >>
+            (env->sregs[WINDOW_BASE] + 1);
+
+        if (windowstart & ((1 << callinc) - 1)) {
+            window_check_ra(env, pc, callinc, GETPC());
+        }
+        env->regs[(callinc << 2) | (s & 3)] = env->regs[s] - imm;
+        xtensa_rotate_window(env, callinc);
+        env->sregs[WINDOW_START] |=
+            windowstart_bit(env->sregs[WINDOW_BASE], env);
     }
 }
 
@@ -305,27 +375,29 @@ uint32_t HELPER(retw)(CPUXtensaState *env, uint32_t pc)
         qemu_log_mask(LOG_GUEST_ERROR, "Illegal retw instruction(pc = %08x), "
                       "PS = %08x, m = %d, n = %d\n",
                       pc, env->sregs[PS], m, n);
-        HELPER(exception_cause)(env, pc, ILLEGAL_INSTRUCTION_CAUSE);
+        exception_cause_ra(env, pc, ILLEGAL_INSTRUCTION_CAUSE, GETPC());
     } else {
         int owb = windowbase;
 
         ret_pc = (pc & 0xc0000000) | (env->regs[0] & 0x3fffffff);
 
-        rotate_window(env, -n);
+        xtensa_rotate_window(env, -n);
         if (windowstart & windowstart_bit(env->sregs[WINDOW_BASE], env)) {
             env->sregs[WINDOW_START] &= ~windowstart_bit(owb, env);
         } else {
             /* window underflow */
+            uintptr_t retaddr = exception_retaddr(env, GETPC());
+
             env->sregs[PS] = (env->sregs[PS] & ~PS_OWB) |
                 (windowbase << PS_OWB_SHIFT) | PS_EXCM;
             env->sregs[EPC1] = env->pc = pc;
 
             if (n == 1) {
-                HELPER(exception)(env, EXC_WINDOW_UNDERFLOW4);
+                exception_ra(env, EXC_WINDOW_UNDERFLOW4, retaddr);
             } else if (n == 2) {
-                HELPER(exception)(env, EXC_WINDOW_UNDERFLOW8);
+                exception_ra(env, EXC_WINDOW_UNDERFLOW8, retaddr);
             } else if (n == 3) {
-                HELPER(exception)(env, EXC_WINDOW_UNDERFLOW12);
+                exception_ra(env, EXC_WINDOW_UNDERFLOW12, retaddr);
             }
         }
     }
@@ -334,38 +406,26 @@ uint32_t HELPER(retw)(CPUXtensaState *env, uint32_t pc)
 
 void HELPER(rotw)(CPUXtensaState *env, uint32_t imm4)
 {
-    rotate_window(env, imm4);
+    xtensa_rotate_window(env, imm4);
 }
 
-void HELPER(restore_owb)(CPUXtensaState *env)
+void xtensa_restore_owb(CPUXtensaState *env)
 {
     rotate_window_abs(env, (env->sregs[PS] & PS_OWB) >> PS_OWB_SHIFT);
 }
 
+void HELPER(restore_owb)(CPUXtensaState *env)
+{
+    xtensa_restore_owb(env);
+}
+
 void HELPER(movsp)(CPUXtensaState *env, uint32_t pc)
 {
     if ((env->sregs[WINDOW_START] &
             (windowstart_bit(env->sregs[WINDOW_BASE] - 3, env) |
              windowstart_bit(env->sregs[WINDOW_BASE] - 2, env) |
              windowstart_bit(env->sregs[WINDOW_BASE] - 1, env))) == 0) {
-        HELPER(exception_cause)(env, pc, ALLOCA_CAUSE);
-    }
-}
-
-void HELPER(wsr_lbeg)(CPUXtensaState *env, uint32_t v)
-{
-    if (env->sregs[LBEG] != v) {
-        tb_invalidate_virtual_addr(env, env->sregs[LEND] - 1);
-        env->sregs[LBEG] = v;
-    }
-}
-
-void HELPER(wsr_lend)(CPUXtensaState *env, uint32_t v)
-{
-    if (env->sregs[LEND] != v) {
-        tb_invalidate_virtual_addr(env, env->sregs[LEND] - 1);
-        env->sregs[LEND] = v;
-        tb_invalidate_virtual_addr(env, env->sregs[LEND] - 1);
+        exception_cause_ra(env, pc, ALLOCA_CAUSE, GETPC());
     }
 }
 
@@ -384,9 +444,9 @@ void HELPER(waiti)(CPUXtensaState *env, uint32_t pc, uint32_t intlevel)
     env->sregs[PS] = (env->sregs[PS] & ~PS_INTLEVEL) |
         (intlevel << PS_INTLEVEL_SHIFT);
 
-    qemu_mutex_lock_iothread();
-    check_interrupts(env);
-    qemu_mutex_unlock_iothread();
+#ifndef CONFIG_USER_ONLY
+    check_interrupts_local(env);
+#endif
 
     if (env->pending_irq_level) {
         cpu_loop_exit(CPU(xtensa_env_get_cpu(env)));
@@ -395,12 +455,25 @@ void HELPER(waiti)(CPUXtensaState *env, uint32_t pc, uint32_t intlevel)
 
     cpu = CPU(xtensa_env_get_cpu(env));
     cpu->halted = 1;
+#ifndef CONFIG_USER_ONLY
+    if (env->ccount_insns) {
+        xtensa_ccount_insns_halt(env);
+    }
+#endif
     HELPER(exception)(env, EXCP_HLT);
 }
 
 void HELPER(update_ccount)(CPUXtensaState *env)
 {
-    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    uint64_t now;
+
+#ifndef CONFIG_USER_ONLY
+    if (env->ccount_insns && !env->ccount_halted) {
+        env->sregs[CCOUNT] = xtensa_ccount_insns_get(env);
+        return;
+    }
+#endif
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
     env->ccount_time = now;
     env->sregs[CCOUNT] = env->ccount_base +
@@ -412,6 +485,12 @@ void HELPER(wsr_ccount)(CPUXtensaState *env, uint32_t v)
 {
     int i;
 
+#ifndef CONFIG_USER_ONLY
+    if (env->ccount_insns) {
+        xtensa_ccount_insns_set(env, v);
+        return;
+    }
+#endif
     HELPER(update_ccount)(env);
     env->ccount_base += v - env->sregs[CCOUNT];
     for (i = 0; i < env->config->nccompare; ++i) {
@@ -423,6 +502,12 @@ void HELPER(update_ccompare)(CPUXtensaState *env, uint32_t i)
 {
     uint64_t dcc;
 
+#ifndef CONFIG_USER_ONLY
+    if (env->ccount_insns) {
+        xtensa_ccount_insns_set(env, xtensa_ccount_insns_get(env));
+        return;
+    }
+#endif
     HELPER(update_ccount)(env);
     dcc = (uint64_t)(env->sregs[CCOMPARE + i] - env->sregs[CCOUNT] - 1) + 1;
     timer_mod(env->ccompare[i].timer,
@@ -430,11 +515,40 @@ void HELPER(update_ccompare)(CPUXtensaState *env, uint32_t i)
     env->yield_needed = 1;
 }
 
+void HELPER(wsr_ccompare)(CPUXtensaState *env, uint32_t i)
+{
+    atomic_and(&env->sregs[INTSET], ~(1u << env->config->timerint[i]));
+    HELPER(update_ccompare)(env, i);
+}
+
+void HELPER(ccount_expired)(CPUXtensaState *env)
+{
+#ifndef CONFIG_USER_ONLY
+    xtensa_ccount_insns_advance(env, xtensa_ccount_insns_get(env));
+#endif
+}
+
 void HELPER(check_interrupts)(CPUXtensaState *env)
 {
-    qemu_mutex_lock_iothread();
-    check_interrupts(env);
-    qemu_mutex_unlock_iothread();
+#ifndef CONFIG_USER_ONLY
+    check_interrupts_local(env);
+#endif
+}
+
+void HELPER(intset)(CPUXtensaState *env, uint32_t v)
+{
+    atomic_or(&env->sregs[INTSET],
+              v & env->config->inttype_mask[INTTYPE_SOFTWARE]);
+    HELPER(check_interrupts)(env);
+}
+
+void HELPER(intclear)(CPUXtensaState *env, uint32_t v)
+{
+    atomic_and(&env->sregs[INTSET],
+               ~(v & (env->config->inttype_mask[INTTYPE_EDGE] |
+                      env->config->inttype_mask[INTTYPE_NMI] |
+                      env->config->inttype_mask[INTTYPE_SOFTWARE])));
+    HELPER(check_interrupts)(env);
 }
 
 void HELPER(itlb_hit_test)(CPUXtensaState *env, uint32_t vaddr)
@@ -465,7 +579,7 @@ void HELPER(check_atomctl)(CPUXtensaState *env, uint32_t pc, uint32_t vaddr)
     }
 
     if (rc) {
-        HELPER(exception_cause_vaddr)(env, pc, rc, vaddr);
+        exception_cause_vaddr_ra(env, pc, rc, vaddr, GETPC());
     }
 
     /*
@@ -486,14 +600,14 @@ void HELPER(check_atomctl)(CPUXtensaState *env, uint32_t pc, uint32_t vaddr)
         /* fall through */
     case PAGE_CACHE_BYPASS:
         if ((atomctl & 0x3) == 0) {
-            HELPER(exception_cause_vaddr)(env, pc,
-                    LOAD_STORE_ERROR_CAUSE, vaddr);
+            exception_cause_vaddr_ra(env, pc, LOAD_STORE_ERROR_CAUSE, vaddr,
+                                     GETPC());
         }
         break;
 
     case PAGE_CACHE_ISOLATE:
-        HELPER(exception_cause_vaddr)(env, pc,
-                LOAD_STORE_ERROR_CAUSE, vaddr);
+        exception_cause_vaddr_ra(env, pc, LOAD_STORE_ERROR_CAUSE, vaddr,
+                                 GETPC());
         break;
 
     default:
@@ -531,8 +645,18 @@ void HELPER(wsr_rasid)(CPUXtensaState *env, uint32_t v)
 
     v = (v & 0xffffff00) | 0x1;
     if (v != env->sregs[RASID]) {
+        uint32_t changed = v ^ env->sregs[RASID];
+
         env->sregs[RASID] = v;
-        tlb_flush(CPU(cpu));
+        /*
+         * Switching ring 1 ASID is what a kernel does on context switch.
+         * Only rings 0 and 1 can see ring 1 pages, let the softmmu TLB keep
+         * translations of other ring 1 address spaces around for them.
+         */
+        if ((changed & 0xffff00ff) != 0) {
+            tlb_flush(CPU(cpu));
+        }
+        tlb_set_asid(CPU(cpu), 0x3, (v >> 8) & 0xff);
     }
 }
 
@@ -730,6 +854,7 @@ void HELPER(itlb)(CPUXtensaState *env, uint32_t v, uint32_t dtlb)
         xtensa_tlb_entry *entry = get_tlb_entry(env, v, dtlb, &wi);
         if (entry->variable && entry->asid) {
             tlb_flush_page(CPU(xtensa_env_get_cpu(env)), entry->vaddr);
+            xtensa_tlb_lookup_cache_flush(env, dtlb, wi, entry->vaddr);
             entry->asid = 0;
         }
     }
@@ -752,7 +877,7 @@ uint32_t HELPER(ptlb)(CPUXtensaState *env, uint32_t v, uint32_t dtlb)
 
         case INST_TLB_MULTI_HIT_CAUSE:
         case LOAD_STORE_TLB_MULTI_HIT_CAUSE:
-            HELPER(exception_cause_vaddr)(env, env->pc, res, v);
+            exception_cause_vaddr_ra(env, env->pc, res, v, GETPC());
             break;
         }
         return 0;
@@ -782,9 +907,11 @@ void xtensa_tlb_set_entry(CPUXtensaState *env, bool dtlb,
         if (entry->variable) {
             if (entry->asid) {
                 tlb_flush_page(cs, entry->vaddr);
+                xtensa_tlb_lookup_cache_flush(env, dtlb, wi, entry->vaddr);
             }
             xtensa_tlb_set_entry_mmu(env, entry, dtlb, wi, ei, vpn, pte);
             tlb_flush_page(cs, entry->vaddr);
+            xtensa_tlb_lookup_cache_flush(env, dtlb, wi, entry->vaddr);
         } else {
             qemu_log_mask(LOG_GUEST_ERROR, "%s %d, %d, %d trying to set immutable entry\n",
                           __func__, dtlb, wi, ei);
@@ -808,7 +935,6 @@ void HELPER(wtlb)(CPUXtensaState *env, uint32_t p, uint32_t v, uint32_t dtlb)
     xtensa_tlb_set_entry(env, dtlb, wi, ei, vpn, p);
 }
 
-
 void HELPER(wsr_ibreakenable)(CPUXtensaState *env, uint32_t v)
 {
     uint32_t change = v ^ env->sregs[IBREAKENABLE];
@@ -859,6 +985,7 @@ static void set_dbreak(CPUXtensaState *env, unsigned i, uint32_t dbreaka,
         qemu_log_mask(LOG_GUEST_ERROR, "Failed to set data breakpoint at 0x%08x/%d\n",
                       dbreaka & mask, ~mask + 1);
     }
+    xtensa_fold_l32r_check_watchpoints(env);
 }
 
 void HELPER(wsr_dbreaka)(CPUXtensaState *env, uint32_t i, uint32_t v)
@@ -912,29 +1039,100 @@ float32 HELPER(neg_s)(float32 v)
     return float32_chs(v);
 }
 
+/*
+ * Host FPU fast path.
+ *
+ * With round-to-nearest-even, zero or normal operands and a host that
+ * evaluates float expressions in single precision, the host FPU result is
+ * bit-exact with softfloat: such operands cannot produce a NaN, and IEEE
+ * guarantees the same correctly rounded result for everything else.
+ * FSR flags are not maintained by this emulation, so nothing is lost by
+ * not going through softfloat. Anything else takes the softfloat path.
+ */
+#if FLT_EVAL_METHOD == 0
+#define XTENSA_HOST_FP 1
+#else
+#define XTENSA_HOST_FP 0
+#endif
+
+typedef union {
+    float32 s;
+    float h;
+} XtensaFloat32;
+
+static inline float fp_to_host(float32 v)
+{
+    XtensaFloat32 u = { .s = v };
+    return u.h;
+}
+
+static inline float32 fp_from_host(float v)
+{
+    XtensaFloat32 u = { .h = v };
+    return u.s;
+}
+
+static inline bool fp_host_operand(float32 v)
+{
+    uint32_t exp = extract32(float32_val(v), 23, 8);
+
+    return float32_is_zero(v) || (exp != 0 && exp != 0xff);
+}
+
+static inline bool fp_host_ok2(CPUXtensaState *env, float32 a, float32 b)
+{
+    return XTENSA_HOST_FP &&
+        likely(get_float_rounding_mode(&env->fp_status) ==
+               float_round_nearest_even &&
+               fp_host_operand(a) && fp_host_operand(b));
+}
+
+static inline bool fp_host_ok3(CPUXtensaState *env,
+                               float32 a, float32 b, float32 c)
+{
+    return fp_host_ok2(env, a, b) && fp_host_operand(c);
+}
+
 float32 HELPER(add_s)(CPUXtensaState *env, float32 a, float32 b)
 {
+    if (fp_host_ok2(env, a, b)) {
+        return fp_from_host(fp_to_host(a) + fp_to_host(b));
+    }
     return float32_add(a, b, &env->fp_status);
 }
 
 float32 HELPER(sub_s)(CPUXtensaState *env, float32 a, float32 b)
 {
+    if (fp_host_ok2(env, a, b)) {
+        return fp_from_host(fp_to_host(a) - fp_to_host(b));
+    }
     return float32_sub(a, b, &env->fp_status);
 }
 
 float32 HELPER(mul_s)(CPUXtensaState *env, float32 a, float32 b)
 {
+    if (fp_host_ok2(env, a, b)) {
+        return fp_from_host(fp_to_host(a) * fp_to_host(b));
+    }
     return float32_mul(a, b, &env->fp_status);
 }
 
 float32 HELPER(madd_s)(CPUXtensaState *env, float32 a, float32 b, float32 c)
 {
+    if (fp_host_ok3(env, a, b, c)) {
+        return fp_from_host(fmaf(fp_to_host(b), fp_to_host(c),
+                                 fp_to_host(a)));
+    }
     return float32_muladd(b, c, a, 0,
             &env->fp_status);
 }
 
 float32 HELPER(msub_s)(CPUXtensaState *env, float32 a, float32 b, float32 c)
 {
+    if (fp_host_ok3(env, a, b, c)) {
+        return fp_from_host(fmaf(-fp_to_host(b), fp_to_host(c),
+                                 fp_to_host(a)));
+    }
     return float32_muladd(b, c, a, float_muladd_negate_product,
             &env->fp_status);
 }
@@ -976,61 +1174,91 @@ float32 HELPER(uitof)(CPUXtensaState *env, uint32_t v, uint32_t scale)
             (int32_t)scale, &env->fp_status);
 }
 
-static inline void set_br(CPUXtensaState *env, bool v, uint32_t br)
+/* Comparisons of non-NaN operands are exact on the host */
+static inline bool fp_ordered(float32 a, float32 b)
 {
-    if (v) {
-        env->sregs[BR] |= br;
-    } else {
-        env->sregs[BR] &= ~br;
-    }
+    return likely(!float32_is_any_nan(a) && !float32_is_any_nan(b));
 }
 
-void HELPER(un_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(un_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    set_br(env, float32_unordered_quiet(a, b, &env->fp_status), br);
+    if (fp_ordered(a, b)) {
+        return 0;
+    }
+    return float32_unordered_quiet(a, b, &env->fp_status);
 }
 
-void HELPER(oeq_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(oeq_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    set_br(env, float32_eq_quiet(a, b, &env->fp_status), br);
+    if (fp_ordered(a, b)) {
+        return fp_to_host(a) == fp_to_host(b);
+    }
+    return float32_eq_quiet(a, b, &env->fp_status);
 }
 
-void HELPER(ueq_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(ueq_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    int v = float32_compare_quiet(a, b, &env->fp_status);
-    set_br(env, v == float_relation_equal || v == float_relation_unordered, br);
+    int v;
+
+    if (fp_ordered(a, b)) {
+        return fp_to_host(a) == fp_to_host(b);
+    }
+    v = float32_compare_quiet(a, b, &env->fp_status);
+    return v == float_relation_equal || v == float_relation_unordered;
 }
 
-void HELPER(olt_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(olt_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    set_br(env, float32_lt_quiet(a, b, &env->fp_status), br);
+    if (fp_ordered(a, b)) {
+        return fp_to_host(a) < fp_to_host(b);
+    }
+    return float32_lt_quiet(a, b, &env->fp_status);
 }
 
-void HELPER(ult_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(ult_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    int v = float32_compare_quiet(a, b, &env->fp_status);
-    set_br(env, v == float_relation_less || v == float_relation_unordered, br);
+    int v;
+
+    if (fp_ordered(a, b)) {
+        return fp_to_host(a) < fp_to_host(b);
+    }
+    v = float32_compare_quiet(a, b, &env->fp_status);
+    return v == float_relation_less || v == float_relation_unordered;
 }
 
-void HELPER(ole_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(ole_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    set_br(env, float32_le_quiet(a, b, &env->fp_status), br);
+    if (fp_ordered(a, b)) {
+        return fp_to_host(a) <= fp_to_host(b);
+    }
+    return float32_le_quiet(a, b, &env->fp_status);
 }
 
-void HELPER(ule_s)(CPUXtensaState *env, uint32_t br, float32 a, float32 b)
+uint32_t HELPER(ule_s)(CPUXtensaState *env, float32 a, float32 b)
 {
-    int v = float32_compare_quiet(a, b, &env->fp_status);
-    set_br(env, v != float_relation_greater, br);
+    int v;
+
+    if (fp_ordered(a, b)) {
+        return fp_to_host(a) <= fp_to_host(b);
+    }
+    v = float32_compare_quiet(a, b, &env->fp_status);
+    return v != float_relation_greater;
 }
 
 uint32_t HELPER(rer)(CPUXtensaState *env, uint32_t addr)
 {
+#ifndef CONFIG_USER_ONLY
     return address_space_ldl(env->address_space_er, addr,
                              MEMTXATTRS_UNSPECIFIED, NULL);
+#else
+    return 0;
+#endif
 }
 
 void HELPER(wer)(CPUXtensaState *env, uint32_t data, uint32_t addr)
 {
+#ifndef CONFIG_USER_ONLY
     address_space_stl(env->address_space_er, addr, data,
                       MEMTXATTRS_UNSPECIFIED, NULL);
+#endif
 }
@@ -49,16 +49,19 @@
 
 /* is_jmp field values */
 #define DISAS_UPDATE  DISAS_TARGET_0 /* cpu state was modified dynamically */
+#define DISAS_FOLLOW  DISAS_TARGET_1 /* direct jump, continue at next_pc */
 
 struct DisasContext {
+    CPUXtensaState *env;
     const XtensaConfig *config;
     TranslationBlock *tb;
     uint32_t pc;
     uint32_t next_pc;
     int cring;
     int ring;
-    uint32_t lbeg;
+    uint32_t lbeg_off;
     uint32_t lend;
+    TCGLabel *loop_label;
     int is_jmp;
     int singlestep_enabled;
 
@@ -67,13 +70,25 @@ struct DisasContext {
     bool sar_m32_allocated;
     TCGv_i32 sar_m32;
 
+    /* Register window frames known to be available in this TB */
     unsigned window;
+    unsigned window_guards;
 
     bool debug;
     bool icount;
     TCGv_i32 next_icount;
+    bool icount_batch;
+    TCGOp *icount_batch_op;
 
+    bool ccount_insns;
+    TCGOp *ccount_insns_op;
+
+    /* Coprocessors known to be enabled in this TB */
     unsigned cpenable;
+    unsigned cpenable_guards;
+
+    bool follow_jumps;
+    unsigned followed_jumps;
 
     uint32_t *raw_arg;
     xtensa_insnbuf insnbuf;
@@ -81,6 +96,7 @@ struct DisasContext {
 };
 
 static TCGv_i32 cpu_pc;
+static TCGv_ptr cpu_regs;
 static TCGv_i32 cpu_R[16];
 static TCGv_i32 cpu_FR[16];
 static TCGv_i32 cpu_SR[256];
@@ -229,9 +245,12 @@ void xtensa_translate_init(void)
     cpu_pc = tcg_global_mem_new_i32(cpu_env,
             offsetof(CPUXtensaState, pc), "pc");
 
+    cpu_regs = tcg_global_mem_new_ptr(cpu_env,
+            offsetof(CPUXtensaState, regs), "regs");
+
     for (i = 0; i < 16; i++) {
-        cpu_R[i] = tcg_global_mem_new_i32(cpu_env,
-                offsetof(CPUXtensaState, regs[i]),
+        cpu_R[i] = tcg_global_mem_new_i32(cpu_regs,
+                i * sizeof(uint32_t),
                 regnames[i]);
     }
 
@@ -353,13 +372,24 @@ static bool gen_check_privilege(DisasContext *dc)
     return true;
 }
 
+/*
+ * CPENABLE is not a part of the TB flags, check it at runtime on the first
+ * use of each coprocessor in the TB. Writing CPENABLE ends the TB.
+ */
 static bool gen_check_cpenable(DisasContext *dc, unsigned cp)
 {
     if (option_enabled(dc, XTENSA_OPTION_COPROCESSOR) &&
             !(dc->cpenable & (1 << cp))) {
+        TCGLabel *label = gen_new_label();
+        TCGv_i32 tmp = tcg_temp_new_i32();
+
+        tcg_gen_andi_i32(tmp, cpu_SR[CPENABLE], 1 << cp);
+        tcg_gen_brcondi_i32(TCG_COND_NE, tmp, 0, label);
+        tcg_temp_free(tmp);
         gen_exception_cause(dc, COPROCESSOR0_DISABLED + cp);
-        dc->is_jmp = DISAS_UPDATE;
-        return false;
+        gen_set_label(label);
+        dc->cpenable |= 1 << cp;
+        ++dc->cpenable_guards;
     }
     return true;
 }
@@ -377,7 +407,7 @@ static void gen_jump_slot(DisasContext *dc, TCGv dest, int slot)
             tcg_gen_goto_tb(slot);
             tcg_gen_exit_tb((uintptr_t)dc->tb + slot);
         } else {
-            tcg_gen_exit_tb(0);
+            tcg_gen_lookup_and_goto_ptr();
         }
     }
     dc->is_jmp = DISAS_UPDATE;
@@ -388,6 +418,23 @@ static void gen_jump(DisasContext *dc, TCGv dest)
     gen_jump_slot(dc, dest, -1);
 }
 
+/*
+ * Continue translation at the target of a direct jump instead of ending
+ * the TB. Only forward jumps within the TB page are followed, so that
+ * [tb->pc, tb->pc + tb->size) covers all translated code.
+ */
+static bool gen_follow_jump(DisasContext *dc, uint32_t dest)
+{
+    if (dc->follow_jumps && dest >= dc->next_pc &&
+        ((dc->tb->pc ^ dest) & TARGET_PAGE_MASK) == 0) {
+        dc->next_pc = dest;
+        dc->is_jmp = DISAS_FOLLOW;
+        ++dc->followed_jumps;
+        return true;
+    }
+    return false;
+}
+
 static void gen_jumpi(DisasContext *dc, uint32_t dest, int slot)
 {
     TCGv_i32 tmp = tcg_const_i32(dest);
@@ -400,8 +447,7 @@ static void gen_jumpi(DisasContext *dc, uint32_t dest, int slot)
     tcg_temp_free(tmp);
 }
 
-static void gen_callw_slot(DisasContext *dc, int callinc, TCGv_i32 dest,
-        int slot)
+static void gen_callw_prepare(DisasContext *dc, int callinc)
 {
     TCGv_i32 tcallinc = tcg_const_i32(callinc);
 
@@ -410,6 +456,12 @@ static void gen_callw_slot(DisasContext *dc, int callinc, TCGv_i32 dest,
     tcg_temp_free(tcallinc);
     tcg_gen_movi_i32(cpu_R[callinc << 2],
             (callinc << 30) | (dc->next_pc & 0x3fffffff));
+}
+
+static void gen_callw_slot(DisasContext *dc, int callinc, TCGv_i32 dest,
+        int slot)
+{
+    gen_callw_prepare(dc, callinc);
     gen_jump_slot(dc, dest, slot);
 }
 
@@ -420,13 +472,19 @@ static void gen_callw(DisasContext *dc, int callinc, TCGv_i32 dest)
 
 static void gen_callwi(DisasContext *dc, int callinc, uint32_t dest, int slot)
 {
-    TCGv_i32 tmp = tcg_const_i32(dest);
+    TCGv_i32 tmp;
+
+    gen_callw_prepare(dc, callinc);
+    if (gen_follow_jump(dc, dest)) {
+        return;
+    }
+    tmp = tcg_const_i32(dest);
 #ifndef CONFIG_USER_ONLY
     if (((dc->tb->pc ^ dest) & TARGET_PAGE_MASK) != 0) {
         slot = -1;
     }
 #endif
-    gen_callw_slot(dc, callinc, tmp, slot);
+    gen_jump_slot(dc, tmp, slot);
     tcg_temp_free(tmp);
 }
 
@@ -439,7 +497,26 @@ static bool gen_check_loop_end(DisasContext *dc, int slot)
 
         tcg_gen_brcondi_i32(TCG_COND_EQ, cpu_SR[LCOUNT], 0, label);
         tcg_gen_subi_i32(cpu_SR[LCOUNT], cpu_SR[LCOUNT], 1);
-        gen_jumpi(dc, dc->lbeg, slot);
+        if (dc->loop_label) {
+            /*
+             * This TB starts at LBEG: branch back to its beginning unless
+             * an exit is requested, in which case TB_EXIT_REQUESTED makes
+             * the next lookup start at tb->pc == LBEG.
+             */
+            TCGv_i32 tmp = tcg_temp_new_i32();
+
+            tcg_gen_ld_i32(tmp, cpu_env,
+                           -ENV_OFFSET + offsetof(CPUState, icount_decr.u32));
+            tcg_gen_brcondi_i32(TCG_COND_LT, tmp, 0,
+                                tcg_ctx->exitreq_label);
+            tcg_temp_free(tmp);
+            tcg_gen_br(dc->loop_label);
+            dc->is_jmp = DISAS_UPDATE;
+        } else if (dc->lbeg_off) {
+            gen_jumpi(dc, dc->next_pc - dc->lbeg_off, slot);
+        } else {
+            gen_jump(dc, cpu_SR[LBEG]);
+        }
         gen_set_label(label);
         gen_jumpi(dc, dc->next_pc, -1);
         return true;
@@ -500,6 +577,21 @@ static bool gen_check_sr(DisasContext *dc, uint32_t sr, unsigned access)
 
 static bool gen_rsr_ccount(DisasContext *dc, TCGv_i32 d, uint32_t sr)
 {
+    if (dc->ccount_insns && sr == CCOUNT) {
+        TCGv_i32 tmp = tcg_temp_new_i32();
+
+        /*
+         * The budget is charged for the whole TB when it starts, so end
+         * the TB here to make the value exact.
+         */
+        tcg_gen_ld_i32(d, cpu_env,
+                       offsetof(CPUXtensaState, ccount_deadline));
+        tcg_gen_ld_i32(tmp, cpu_env,
+                       offsetof(CPUXtensaState, ccount_budget));
+        tcg_gen_sub_i32(d, d, tmp);
+        tcg_temp_free(tmp);
+        return true;
+    }
     if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
         gen_io_start();
     }
@@ -512,6 +604,20 @@ static bool gen_rsr_ccount(DisasContext *dc, TCGv_i32 d, uint32_t sr)
     return false;
 }
 
+static bool gen_rsr_icount(DisasContext *dc, TCGv_i32 d, uint32_t sr)
+{
+    if (dc->icount_batch) {
+        /*
+         * ICOUNT already includes the whole TB, which ends here and
+         * thus counts this instruction as well.
+         */
+        tcg_gen_subi_i32(d, cpu_SR[sr], 1);
+        return true;
+    }
+    tcg_gen_mov_i32(d, cpu_SR[sr]);
+    return false;
+}
+
 static bool gen_rsr_ptevaddr(DisasContext *dc, TCGv_i32 d, uint32_t sr)
 {
     tcg_gen_shri_i32(d, cpu_SR[EXCVADDR], 10);
@@ -526,6 +632,7 @@ static bool gen_rsr(DisasContext *dc, TCGv_i32 d, uint32_t sr)
             TCGv_i32 d, uint32_t sr) = {
         [CCOUNT] = gen_rsr_ccount,
         [INTSET] = gen_rsr_ccount,
+        [ICOUNT] = gen_rsr_icount,
         [PTEVADDR] = gen_rsr_ptevaddr,
     };
 
@@ -539,15 +646,23 @@ static bool gen_rsr(DisasContext *dc, TCGv_i32 d, uint32_t sr)
 
 static bool gen_wsr_lbeg(DisasContext *dc, uint32_t sr, TCGv_i32 s)
 {
-    gen_helper_wsr_lbeg(cpu_env, s);
-    gen_jumpi_check_loop_end(dc, 0);
+    tcg_gen_mov_i32(cpu_SR[sr], s);
+    /*
+     * LBEG/LEND are part of cs_base: take the loopback from the new LBEG
+     * value and don't chain to the next TB.
+     */
+    dc->lbeg_off = 0;
+    dc->loop_label = NULL;
+    gen_jumpi_check_loop_end(dc, -1);
     return false;
 }
 
 static bool gen_wsr_lend(DisasContext *dc, uint32_t sr, TCGv_i32 s)
 {
-    gen_helper_wsr_lend(cpu_env, s);
-    gen_jumpi_check_loop_end(dc, 0);
+    tcg_gen_mov_i32(cpu_SR[sr], s);
+    dc->lbeg_off = 0;
+    dc->loop_label = NULL;
+    gen_jumpi_check_loop_end(dc, -1);
     return false;
 }
 
@@ -694,26 +809,32 @@ static void gen_check_interrupts(DisasContext *dc)
     }
 }
 
+/*
+ * INTSET is also changed by devices without synchronization with the vCPU,
+ * so it's only modified atomically in helpers, never in TCG code.
+ */
 static bool gen_wsr_intset(DisasContext *dc, uint32_t sr, TCGv_i32 v)
 {
-    tcg_gen_andi_i32(cpu_SR[sr], v,
-            dc->config->inttype_mask[INTTYPE_SOFTWARE]);
-    gen_check_interrupts(dc);
+    if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
+        gen_io_start();
+    }
+    gen_helper_intset(cpu_env, v);
+    if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
+        gen_io_end();
+    }
     gen_jumpi_check_loop_end(dc, 0);
     return true;
 }
 
 static bool gen_wsr_intclear(DisasContext *dc, uint32_t sr, TCGv_i32 v)
 {
-    TCGv_i32 tmp = tcg_temp_new_i32();
-
-    tcg_gen_andi_i32(tmp, v,
-            dc->config->inttype_mask[INTTYPE_EDGE] |
-            dc->config->inttype_mask[INTTYPE_NMI] |
-            dc->config->inttype_mask[INTTYPE_SOFTWARE]);
-    tcg_gen_andc_i32(cpu_SR[INTSET], cpu_SR[INTSET], tmp);
-    tcg_temp_free(tmp);
-    gen_check_interrupts(dc);
+    if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
+        gen_io_start();
+    }
+    gen_helper_intclear(cpu_env, v);
+    if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
+        gen_io_end();
+    }
     gen_jumpi_check_loop_end(dc, 0);
     return true;
 }
@@ -761,6 +882,11 @@ static bool gen_wsr_icount(DisasContext *dc, uint32_t sr, TCGv_i32 v)
         tcg_gen_mov_i32(dc->next_icount, v);
     } else {
         tcg_gen_mov_i32(cpu_SR[sr], v);
+        if (dc->icount_batch) {
+            /* The new value may need per-instruction accounting */
+            gen_jumpi_check_loop_end(dc, -1);
+            return true;
+        }
     }
     return false;
 }
@@ -779,15 +905,13 @@ static bool gen_wsr_ccompare(DisasContext *dc, uint32_t sr, TCGv_i32 v)
     bool ret = false;
 
     if (id < dc->config->nccompare) {
-        uint32_t int_bit = 1 << dc->config->timerint[id];
         TCGv_i32 tmp = tcg_const_i32(id);
 
         tcg_gen_mov_i32(cpu_SR[sr], v);
-        tcg_gen_andi_i32(cpu_SR[INTSET], cpu_SR[INTSET], ~int_bit);
         if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
             gen_io_start();
         }
-        gen_helper_update_ccompare(cpu_env, tmp);
+        gen_helper_wsr_ccompare(cpu_env, tmp);
         if (tb_cflags(dc->tb) & CF_USE_ICOUNT) {
             gen_io_end();
             gen_jumpi_check_loop_end(dc, 0);
@@ -895,15 +1019,38 @@ static void gen_waiti(DisasContext *dc, uint32_t imm4)
     gen_jumpi_check_loop_end(dc, 0);
 }
 
+/*
+ * The window depth is not a part of the TB flags, check at runtime that
+ * WINDOW_START has no bits set in the frames covering r1 on the first
+ * access to each frame in the TB. Instructions that change the window
+ * end the TB.
+ */
 static bool gen_window_check1(DisasContext *dc, unsigned r1)
 {
     if (r1 / 4 > dc->window) {
-        TCGv_i32 pc = tcg_const_i32(dc->pc);
-        TCGv_i32 w = tcg_const_i32(r1 / 4);
-
+        TCGLabel *label = gen_new_label();
+        TCGv_i32 ws = tcg_temp_new_i32();
+        TCGv_i32 sh = tcg_temp_new_i32();
+        TCGv_i32 pc;
+        TCGv_i32 w;
+
+        tcg_gen_shli_i32(ws, cpu_SR[WINDOW_START], dc->config->nareg / 4);
+        tcg_gen_or_i32(ws, ws, cpu_SR[WINDOW_START]);
+        tcg_gen_addi_i32(sh, cpu_SR[WINDOW_BASE], 1);
+        tcg_gen_shr_i32(ws, ws, sh);
+        tcg_gen_andi_i32(ws, ws, (1 << (r1 / 4)) - 1);
+        tcg_gen_brcondi_i32(TCG_COND_EQ, ws, 0, label);
+        tcg_temp_free(sh);
+        tcg_temp_free(ws);
+
+        pc = tcg_const_i32(dc->pc);
+        w = tcg_const_i32(r1 / 4);
         gen_helper_window_check(cpu_env, pc, w);
-        dc->is_jmp = DISAS_UPDATE;
-        return false;
+        tcg_temp_free(w);
+        tcg_temp_free(pc);
+        gen_set_label(label);
+        dc->window = r1 / 4;
+        ++dc->window_guards;
     }
     return true;
 }
@@ -936,11 +1083,54 @@ static inline unsigned xtensa_op0_insn_len(DisasContext *dc, uint8_t op0)
     return xtensa_isa_length_from_chars(dc->config->isa, &op0);
 }
 
+/*
+ * Translation is serialized by tb_lock, so the decode cache may be
+ * updated without additional locking.
+ */
+static XtensaDecodedInsn *xtensa_decode_cache_entry(DisasContext *dc,
+                                                    const unsigned char *b,
+                                                    unsigned len,
+                                                    uint64_t *insn)
+{
+    uint64_t v = 0;
+    unsigned i;
+
+    if (len > sizeof(v)) {
+        return NULL;
+    }
+    for (i = 0; i < len; ++i) {
+        v |= (uint64_t)b[i] << (i * 8);
+    }
+    *insn = v;
+    return dc->config->decode_cache +
+        ((v * 0x9e3779b97f4a7c15ull) >> (64 - XTENSA_DECODE_CACHE_BITS));
+}
+
+static void translate_decoded_insn(DisasContext *dc,
+                                   const XtensaDecodedInsn *insn)
+{
+    uint32_t raw_arg[MAX_OPCODE_ARGS];
+    uint32_t arg[MAX_OPCODE_ARGS];
+    unsigned i;
+
+    dc->raw_arg = raw_arg;
+    for (i = 0; i < insn->nargs; ++i) {
+        raw_arg[i] = arg[i] = insn->raw_arg[i];
+        if (insn->pcrel & (1u << i)) {
+            xtensa_operand_undo_reloc(dc->config->isa, insn->opc,
+                                      insn->opnd[i], arg + i, dc->pc);
+        }
+    }
+    insn->ops->translate(dc, arg, insn->ops->par);
+}
+
 static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
 {
     xtensa_isa isa = dc->config->isa;
     unsigned char b[MAX_INSN_LENGTH] = {cpu_ldub_code(env, dc->pc)};
     unsigned len = xtensa_op0_insn_len(dc, b[0]);
+    XtensaDecodedInsn *cached;
+    uint64_t insn = 0;
     xtensa_format fmt;
     int slot, slots;
     unsigned i;
@@ -957,6 +1147,13 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
     for (i = 1; i < len; ++i) {
         b[i] = cpu_ldub_code(env, dc->pc + i);
     }
+
+    cached = xtensa_decode_cache_entry(dc, b, len, &insn);
+    if (cached && cached->len == len && cached->insn == insn) {
+        translate_decoded_insn(dc, cached);
+        goto done;
+    }
+
     xtensa_insnbuf_from_chars(isa, dc->insnbuf, b, len);
     fmt = xtensa_format_decode(isa, dc->insnbuf);
     if (fmt == XTENSA_UNDEFINED) {
@@ -967,6 +1164,9 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
         return;
     }
     slots = xtensa_format_num_slots(isa, fmt);
+    if (slots != 1) {
+        cached = NULL;
+    }
     for (slot = 0; slot < slots; ++slot) {
         xtensa_opcode opc;
         int opnd, vopnd, opnds;
@@ -1003,6 +1203,24 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
             }
         }
         ops = dc->config->opcode_ops[opc];
+        if (ops && cached) {
+            cached->insn = insn;
+            cached->len = len;
+            cached->opc = opc;
+            cached->ops = ops;
+            cached->nargs = vopnd;
+            cached->pcrel = 0;
+            for (opnd = vopnd = 0; opnd < opnds; ++opnd) {
+                if (xtensa_operand_is_visible(isa, opc, opnd)) {
+                    if (xtensa_operand_is_PCrelative(isa, opc, opnd)) {
+                        cached->pcrel |= 1u << vopnd;
+                    }
+                    cached->opnd[vopnd] = opnd;
+                    cached->raw_arg[vopnd] = raw_arg[vopnd];
+                    ++vopnd;
+                }
+            }
+        }
         if (ops) {
             ops->translate(dc, arg, ops->par);
         } else {
@@ -1013,8 +1231,12 @@ static void disas_xtensa_insn(CPUXtensaState *env, DisasContext *dc)
             return;
         }
     }
+done:
     if (dc->is_jmp == DISAS_NEXT) {
         gen_check_loop_end(dc, 0);
+    } else if (dc->is_jmp == DISAS_FOLLOW) {
+        /* A taken jump to LEND does not loop back */
+        dc->is_jmp = DISAS_NEXT;
     }
     dc->pc = dc->next_pc;
 }
@@ -1038,6 +1260,43 @@ static void gen_ibreak_check(CPUXtensaState *env, DisasContext *dc)
     }
 }
 
+static void gen_ccount_insns_start(DisasContext *dc)
+{
+    TCGLabel *label = gen_new_label();
+    TCGv_i32 budget = tcg_temp_new_i32();
+    TCGv_i32 n = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(budget, cpu_env, offsetof(CPUXtensaState, ccount_budget));
+    /* The number of instructions is patched in when the TB is complete */
+    tcg_gen_movi_i32(n, 0xdeadbeef);
+    dc->ccount_insns_op = tcg_last_op();
+    tcg_gen_sub_i32(budget, budget, n);
+    tcg_gen_st_i32(budget, cpu_env, offsetof(CPUXtensaState, ccount_budget));
+    tcg_gen_brcondi_i32(TCG_COND_GT, budget, 0, label);
+    gen_helper_ccount_expired(cpu_env);
+    gen_set_label(label);
+    tcg_temp_free(n);
+    tcg_temp_free(budget);
+}
+
+/*
+ * Account ICOUNT for the whole TB at once. Near the overflow leave the TB
+ * to get it retranslated with per-instruction checks.
+ */
+static void gen_icount_batch_start(DisasContext *dc)
+{
+    TCGv_i32 n = tcg_temp_new_i32();
+
+    tcg_gen_brcondi_i32(TCG_COND_GEU, cpu_SR[ICOUNT],
+                        (uint32_t)-XTENSA_ICOUNT_BATCH_MAX,
+                        tcg_ctx->exitreq_label);
+    /* The number of instructions is patched in when the TB is complete */
+    tcg_gen_movi_i32(n, 0xdeadbeef);
+    dc->icount_batch_op = tcg_last_op();
+    tcg_gen_add_i32(cpu_SR[ICOUNT], cpu_SR[ICOUNT], n);
+    tcg_temp_free(n);
+}
+
 void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
 {
     CPUXtensaState *env = cs->env_ptr;
@@ -1054,22 +1313,36 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
     if (max_insns > TCG_MAX_INSNS) {
         max_insns = TCG_MAX_INSNS;
     }
+    if (max_insns > XTENSA_ICOUNT_BATCH_MAX) {
+        max_insns = XTENSA_ICOUNT_BATCH_MAX;
+    }
 
+    dc.env = env;
     dc.config = env->config;
     dc.singlestep_enabled = cs->singlestep_enabled;
     dc.tb = tb;
     dc.pc = pc_start;
     dc.ring = tb->flags & XTENSA_TBFLAG_RING_MASK;
     dc.cring = (tb->flags & XTENSA_TBFLAG_EXCM) ? 0 : dc.ring;
-    dc.lbeg = env->sregs[LBEG];
-    dc.lend = env->sregs[LEND];
+    dc.lbeg_off = (tb->cs_base & XTENSA_CSBASE_LBEG_OFF_MASK) >>
+        XTENSA_CSBASE_LBEG_OFF_SHIFT;
+    dc.lend = ((tb->cs_base & XTENSA_CSBASE_LEND_MASK) >>
+               XTENSA_CSBASE_LEND_SHIFT) + (pc_start & TARGET_PAGE_MASK);
+    dc.loop_label = NULL;
     dc.is_jmp = DISAS_NEXT;
     dc.debug = tb->flags & XTENSA_TBFLAG_DEBUG;
-    dc.icount = tb->flags & XTENSA_TBFLAG_ICOUNT;
-    dc.cpenable = (tb->flags & XTENSA_TBFLAG_CPENABLE_MASK) >>
-        XTENSA_TBFLAG_CPENABLE_SHIFT;
-    dc.window = ((tb->flags & XTENSA_TBFLAG_WINDOW_MASK) >>
-                 XTENSA_TBFLAG_WINDOW_SHIFT);
+    dc.icount = (tb->flags & XTENSA_TBFLAG_ICOUNT) &&
+        !(tb->flags & XTENSA_TBFLAG_ICOUNT_BATCH);
+    dc.icount_batch = tb->flags & XTENSA_TBFLAG_ICOUNT_BATCH;
+    dc.icount_batch_op = NULL;
+    dc.ccount_insns = env->ccount_insns;
+    dc.ccount_insns_op = NULL;
+    dc.cpenable = 0;
+    dc.cpenable_guards = 0;
+    dc.window = (tb->flags & XTENSA_TBFLAG_WINDOW_CHECK) ? 0 : 3;
+    dc.window_guards = 0;
+    dc.follow_jumps = env->follow_jumps && !cs->singlestep_enabled;
+    dc.followed_jumps = 0;
 
     if (dc.config->isa) {
         dc.insnbuf = xtensa_insnbuf_alloc(dc.config->isa);
@@ -1085,22 +1358,45 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb)
 
     if ((tb_cflags(tb) & CF_USE_ICOUNT) &&
         (tb->flags & XTENSA_TBFLAG_YIELD)) {
-        tcg_gen_insn_start(dc.pc);
+        tcg_gen_insn_start(dc.pc, 0);
         ++insn_count;
         gen_exception(&dc, EXCP_YIELD);
         dc.is_jmp = DISAS_UPDATE;
         goto done;
     }
     if (tb->flags & XTENSA_TBFLAG_EXCEPTION) {
-        tcg_gen_insn_start(dc.pc);
+        tcg_gen_insn_start(dc.pc, 0);
         ++insn_count;
         gen_exception(&dc, EXCP_DEBUG);
         dc.is_jmp = DISAS_UPDATE;
         goto done;
     }
 
+    /*
+     * A TB that starts at LBEG may hold the whole loop body, in which case
+     * the loopback is a branch inside the TB. This is only done when the
+     * number of executed instructions need not be accounted precisely.
+     */
+    if (dc.lbeg_off && pc_start == dc.lend - dc.lbeg_off &&
+        !(tb->flags & XTENSA_TBFLAG_EXCM) &&
+        !(tb_cflags(tb) & CF_USE_ICOUNT) &&
+        !(tb->flags & XTENSA_TBFLAG_ICOUNT) && !cs->singlestep_enabled) {
+        dc.loop_label = gen_new_label();
+        gen_set_label(dc.loop_label);
+    }
+    /*
+     * The ICOUNT check may leave the TB through the exitreq path,
+     * so do it before CCOUNT budget is charged for the whole TB.
+     */
+    if (dc.icount_batch) {
+        gen_icount_batch_start(&dc);
+    }
+    if (dc.ccount_insns) {
+        gen_ccount_insns_start(&dc);
+    }
+
     do {
-        tcg_gen_insn_start(dc.pc);
+        tcg_gen_insn_start(dc.pc, insn_count);
         ++insn_count;
 
         if (unlikely(cpu_breakpoint_test(cs, dc.pc, BP_ANY))) {
@@ -1166,6 +1462,12 @@ done:
     if (dc.is_jmp == DISAS_NEXT) {
         gen_jumpi(&dc, dc.pc, 0);
     }
+    if (dc.ccount_insns_op) {
+        tcg_set_insn_param(dc.ccount_insns_op, 1, insn_count);
+    }
+    if (dc.icount_batch_op) {
+        tcg_set_insn_param(dc.icount_batch_op, 1, insn_count);
+    }
     gen_tb_end(tb, insn_count);
 
 #ifdef DEBUG_DISAS
@@ -1175,6 +1477,9 @@ done:
         qemu_log("----------------\n");
         qemu_log("IN: %s\n", lookup_symbol(pc_start));
         log_target_disas(cs, pc_start, dc.pc - pc_start);
+        qemu_log("window guards: %u, cpenable guards: %u, "
+                 "followed jumps: %u\n",
+                 dc.window_guards, dc.cpenable_guards, dc.followed_jumps);
         qemu_log("\n");
         qemu_log_unlock();
     }
@@ -1217,6 +1522,7 @@ void xtensa_cpu_dump_state(CPUState *cs, FILE *f,
 
     cpu_fprintf(f, "\n");
 
+    xtensa_sync_phys_from_window(env);
     for (i = 0; i < env->config->nareg; ++i) {
         cpu_fprintf(f, "AR%02d=%08x%c", i, env->phys_regs[i],
                 (i % 4) == 3 ? '\n' : ' ');
@@ -1238,6 +1544,14 @@ void restore_state_to_opc(CPUXtensaState *env, TranslationBlock *tb,
                           target_ulong *data)
 {
     env->pc = data[0];
+    if (tb->flags & XTENSA_TBFLAG_ICOUNT_BATCH) {
+        /* Instructions from the current one to the end of TB didn't run */
+        env->sregs[ICOUNT] -= tb->icount - data[1];
+    }
+    if (env->ccount_insns) {
+        /* The whole TB was charged to CCOUNT budget at its entry */
+        env->ccount_budget += tb->icount - data[1];
+    }
 }
 
 static int compare_opcode_ops(const void *a, const void *b)
@@ -1463,7 +1777,9 @@ static void translate_call0(DisasContext *dc, const uint32_t arg[],
                             const uint32_t par[])
 {
     tcg_gen_movi_i32(cpu_R[0], dc->next_pc);
-    gen_jumpi(dc, arg[0], 0);
+    if (!gen_follow_jump(dc, arg[0])) {
+        gen_jumpi(dc, arg[0], 0);
+    }
 }
 
 static void translate_callw(DisasContext *dc, const uint32_t arg[],
@@ -1622,7 +1938,9 @@ static void translate_ill(DisasContext *dc, const uint32_t arg[],
 static void translate_j(DisasContext *dc, const uint32_t arg[],
                         const uint32_t par[])
 {
-    gen_jumpi(dc, arg[0], 0);
+    if (!gen_follow_jump(dc, arg[0])) {
+        gen_jumpi(dc, arg[0], 0);
+    }
 }
 
 static void translate_jx(DisasContext *dc, const uint32_t arg[],
@@ -1658,24 +1976,117 @@ static void translate_ldst(DisasContext *dc, const uint32_t arg[],
             gen_load_store_alignment(dc, par[0] & MO_SIZE, addr, par[1]);
         }
         if (par[2]) {
+            if (par[1]) {
+                tcg_gen_mb(TCG_BAR_STRL | TCG_MO_ALL);
+            }
             tcg_gen_qemu_st_tl(cpu_R[arg[0]], addr, dc->cring, par[0]);
         } else {
             tcg_gen_qemu_ld_tl(cpu_R[arg[0]], addr, dc->cring, par[0]);
+            if (par[1]) {
+                tcg_gen_mb(TCG_BAR_LDAQ | TCG_MO_ALL);
+            }
         }
         tcg_temp_free(addr);
     }
 }
 
+#ifndef CONFIG_USER_ONLY
+static bool xtensa_addr_in_rom(const XtensaMemory *mem, hwaddr addr)
+{
+    unsigned i;
+
+    for (i = 0; i < mem->num; ++i) {
+        if (addr - mem->location[i].addr < mem->location[i].size) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+/*
+ * Read the literal at vaddr at translation time if it is known not to
+ * change while this TB is valid: it is on the first page of the TB, so
+ * writing it invalidates the TB, or it is in the instruction or data ROM.
+ */
+#ifndef CONFIG_USER_ONLY
+/*
+ * TBs are not invalidated on DTLB changes, so a literal may only be folded
+ * when the guest cannot change the data mapping of its address: there's
+ * no memory protection at all, or the address is in a static MMU way.
+ */
+static bool xtensa_static_data_mapping(CPUXtensaState *env, uint32_t vaddr)
+{
+    if (xtensa_option_enabled(env->config, XTENSA_OPTION_MMU)) {
+        uint32_t wi, ei;
+        uint8_t ring;
+
+        return xtensa_tlb_lookup(env, vaddr, true, &wi, &ei, &ring) == 0 &&
+            !xtensa_tlb_get_entry(env, true, wi, ei)->variable;
+    }
+    return !xtensa_option_bits_enabled(env->config,
+            XTENSA_OPTION_BIT(XTENSA_OPTION_REGION_PROTECTION) |
+            XTENSA_OPTION_BIT(XTENSA_OPTION_REGION_TRANSLATION));
+}
+#endif
+
+static bool xtensa_fold_l32r(DisasContext *dc, uint32_t vaddr, uint32_t *v)
+{
+    CPUXtensaState *env = dc->env;
+    CPUState *cs = CPU(xtensa_env_get_cpu(env));
+    uint32_t tb_page = dc->tb->pc & TARGET_PAGE_MASK;
+
+    if (!env->fold_l32r || !QTAILQ_EMPTY(&cs->watchpoints)) {
+        return false;
+    }
+#ifdef CONFIG_USER_ONLY
+    if ((vaddr & TARGET_PAGE_MASK) != tb_page ||
+        !(page_get_flags(vaddr) & PAGE_READ)) {
+        return false;
+    }
+    *v = cpu_ldl_code(env, vaddr);
+    return true;
+#else
+    {
+        uint32_t paddr, tb_paddr, page_size;
+        unsigned access;
+        MemTxResult res;
+
+        if (!xtensa_static_data_mapping(env, vaddr) ||
+            xtensa_get_physical_addr(env, false, vaddr, 0, dc->cring,
+                                     &paddr, &page_size, &access) != 0) {
+            return false;
+        }
+        if ((vaddr & TARGET_PAGE_MASK) == tb_page &&
+            xtensa_get_physical_addr(env, false, dc->tb->pc, 2, dc->cring,
+                                     &tb_paddr, &page_size, &access) == 0 &&
+            ((paddr ^ tb_paddr) & TARGET_PAGE_MASK) == 0) {
+            /* Writes to the TB page invalidate the TB */
+        } else if (!xtensa_addr_in_rom(&env->config->instrom, paddr) &&
+                   !xtensa_addr_in_rom(&env->config->datarom, paddr)) {
+            return false;
+        }
+        *v = address_space_ldl(cs->as, paddr, MEMTXATTRS_UNSPECIFIED, &res);
+        return res == MEMTX_OK;
+    }
+#endif
+}
+
 static void translate_l32r(DisasContext *dc, const uint32_t arg[],
                            const uint32_t par[])
 {
     if (gen_window_check1(dc, arg[0])) {
         TCGv_i32 tmp;
+        uint32_t v;
 
         if (dc->tb->flags & XTENSA_TBFLAG_LITBASE) {
             tmp = tcg_const_i32(dc->raw_arg[1] - 1);
             tcg_gen_add_i32(tmp, cpu_SR[LITBASE], tmp);
         } else {
+            if (xtensa_fold_l32r(dc, arg[1], &v)) {
+                tcg_gen_movi_i32(cpu_R[arg[0]], v);
+                return;
+            }
             tmp = tcg_const_i32(arg[1]);
         }
         tcg_gen_qemu_ld32u(cpu_R[arg[0]], tmp, dc->cring);
@@ -1688,12 +2099,10 @@ static void translate_loop(DisasContext *dc, const uint32_t arg[],
 {
     if (gen_window_check1(dc, arg[0])) {
         uint32_t lend = arg[1];
-        TCGv_i32 tmp = tcg_const_i32(lend);
 
         tcg_gen_subi_i32(cpu_SR[LCOUNT], cpu_R[arg[0]], 1);
         tcg_gen_movi_i32(cpu_SR[LBEG], dc->next_pc);
-        gen_helper_wsr_lend(cpu_env, tmp);
-        tcg_temp_free(tmp);
+        tcg_gen_movi_i32(cpu_SR[LEND], lend);
 
         if (par[0] != TCG_COND_NEVER) {
             TCGLabel *label = gen_new_label();
@@ -1817,6 +2226,12 @@ static void translate_mac16(DisasContext *dc, const uint32_t arg[],
     }
 }
 
+static void translate_memw(DisasContext *dc, const uint32_t arg[],
+                           const uint32_t par[])
+{
+    tcg_gen_mb(TCG_BAR_SC | TCG_MO_ALL);
+}
+
 static void translate_minmax(DisasContext *dc, const uint32_t arg[],
                              const uint32_t par[])
 {
@@ -2191,25 +2606,23 @@ static void translate_s32c1i(DisasContext *dc, const uint32_t arg[],
                              const uint32_t par[])
 {
     if (gen_window_check2(dc, arg[0], arg[1])) {
-        TCGLabel *label = gen_new_label();
-        TCGv_i32 tmp = tcg_temp_local_new_i32();
-        TCGv_i32 addr = tcg_temp_local_new_i32();
-        TCGv_i32 tpc;
+        TCGv_i32 tmp = tcg_temp_new_i32();
+        TCGv_i32 addr = tcg_temp_new_i32();
 
         tcg_gen_mov_i32(tmp, cpu_R[arg[0]]);
         tcg_gen_addi_i32(addr, cpu_R[arg[1]], arg[2]);
         gen_load_store_alignment(dc, 2, addr, true);
 
-        tpc = tcg_const_i32(dc->pc);
-        gen_helper_check_atomctl(cpu_env, tpc, addr);
-        tcg_gen_qemu_ld32u(cpu_R[arg[0]], addr, dc->cring);
-        tcg_gen_brcond_i32(TCG_COND_NE, cpu_R[arg[0]],
-                           cpu_SR[SCOMPARE1], label);
-
-        tcg_gen_qemu_st32(tmp, addr, dc->cring);
+#ifndef CONFIG_USER_ONLY
+        {
+            TCGv_i32 tpc = tcg_const_i32(dc->pc);
 
-        gen_set_label(label);
-        tcg_temp_free(tpc);
+            gen_helper_check_atomctl(cpu_env, tpc, addr);
+            tcg_temp_free(tpc);
+        }
+#endif
+        tcg_gen_atomic_cmpxchg_i32(cpu_R[arg[0]], addr, cpu_SR[SCOMPARE1],
+                                   tmp, dc->cring, MO_TEUL);
         tcg_temp_free(addr);
         tcg_temp_free(tmp);
     }
@@ -2261,11 +2674,16 @@ static void translate_sext(DisasContext *dc, const uint32_t arg[],
 static void translate_simcall(DisasContext *dc, const uint32_t arg[],
                               const uint32_t par[])
 {
+#ifndef CONFIG_USER_ONLY
     if (semihosting_enabled()) {
         if (gen_check_privilege(dc)) {
             gen_helper_simcall(cpu_env);
+            /* The call may halt the CPU, let it leave at the TB end */
+            gen_jumpi_check_loop_end(dc, -1);
         }
-    } else {
+    } else
+#endif
+    {
         qemu_log_mask(LOG_GUEST_ERROR, "SIMCALL but semihosting is disabled\n");
         gen_exception_cause(dc, ILLEGAL_INSTRUCTION_CAUSE);
     }
@@ -2822,7 +3240,7 @@ static const XtensaOpcodeOps core_ops[] = {
         .translate = translate_extui,
     }, {
         .name = "extw",
-        .translate = translate_nop,
+        .translate = translate_memw,
     }, {
         .name = "hwwdtlba",
         .translate = translate_ill,
@@ -2939,7 +3357,7 @@ static const XtensaOpcodeOps core_ops[] = {
         .par = (const uint32_t[]){TCG_COND_GEU},
     }, {
         .name = "memw",
-        .translate = translate_nop,
+        .translate = translate_memw,
     }, {
         .name = "min",
         .translate = translate_minmax,
@@ -4506,7 +4924,7 @@ enum {
 static void translate_compare_s(DisasContext *dc, const uint32_t arg[],
                                 const uint32_t par[])
 {
-    static void (* const helper[])(TCGv_env env, TCGv_i32 bit,
+    static void (* const helper[])(TCGv_i32 res, TCGv_env env,
                                    TCGv_i32 s, TCGv_i32 t) = {
         [COMPARE_UN] = gen_helper_un_s,
         [COMPARE_OEQ] = gen_helper_oeq_s,
@@ -4518,10 +4936,11 @@ static void translate_compare_s(DisasContext *dc, const uint32_t arg[],
     };
 
     if (gen_check_cpenable(dc, 0)) {
-        TCGv_i32 bit = tcg_const_i32(1 << arg[0]);
+        TCGv_i32 res = tcg_temp_new_i32();
 
-        helper[par[0]](cpu_env, bit, cpu_FR[arg[1]], cpu_FR[arg[2]]);
-        tcg_temp_free(bit);
+        helper[par[0]](res, cpu_env, cpu_FR[arg[1]], cpu_FR[arg[2]]);
+        tcg_gen_deposit_i32(cpu_SR[BR], cpu_SR[BR], res, arg[0], 1);
+        tcg_temp_free(res);
     }
 }
 
@@ -27,11 +27,14 @@
 
 #include "qemu/osdep.h"
 #include "cpu.h"
+#include "block/thread-pool.h"
 #include "chardev/char-fe.h"
+#include "exec/exec-all.h"
 #include "exec/helper-proto.h"
 #include "exec/semihost.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "sysemu/sysemu.h"
 
 static CharBackend *xtensa_sim_console;
@@ -49,6 +52,9 @@ enum {
     TARGET_SYS_argv_sz = 1001,
     TARGET_SYS_argv = 1002,
     TARGET_SYS_memset = 1004,
+
+    /* QEMU extensions */
+    TARGET_SYS_read_file = 2000,
 };
 
 enum {
@@ -162,10 +168,239 @@ void xtensa_sim_open_console(Chardev *chr)
     xtensa_sim_console = &console;
 }
 
-void HELPER(simcall)(CPUXtensaState *env)
+/*
+ * Maximal number of physically contiguous guest memory runs passed to a
+ * single readv/writev call.
+ */
+#define XTENSA_SIM_IOV_MAX 64
+
+typedef struct XtensaSimIO {
+    struct iovec iov[XTENSA_SIM_IOV_MAX];
+    unsigned niov;
+    size_t len;
+} XtensaSimIO;
+
+/*
+ * A simcall with its argument registers. Guest memory that calls which
+ * may block access is looked up in the vCPU thread beforehand, see
+ * xtensa_sim_call_prepare, so that they can run in a worker thread.
+ */
+typedef struct XtensaSimCall {
+    CPUState *cs;
+    uint32_t regs[7];
+    /* File name for open and read_file */
+    char name[1024];
+    bool name_valid;
+    /* Timeout for select_one */
+    uint32_t tv[2];
+    /* Physical addresses of the pages of the buffer at regs[4] */
+    hwaddr *pages;
+    uint32_t npages;
+} XtensaSimCall;
+
+static hwaddr xtensa_sim_phys_addr(const XtensaSimCall *call, uint32_t vaddr)
 {
-    CPUState *cs = CPU(xtensa_env_get_cpu(env));
-    uint32_t *regs = env->regs;
+    uint32_t page = (vaddr >> TARGET_PAGE_BITS) -
+        (call->regs[4] >> TARGET_PAGE_BITS);
+
+    if (page >= call->npages || call->pages[page] == -1) {
+        return -1;
+    }
+    return call->pages[page] | (vaddr & ~TARGET_PAGE_MASK);
+}
+
+/*
+ * Map as much of the guest virtual buffer [vaddr, vaddr + len) as possible
+ * into io->iov, merging pages that are contiguous in the physical memory.
+ * Return false if nothing could be mapped.
+ */
+static bool xtensa_sim_map(const XtensaSimCall *call, XtensaSimIO *io,
+                           uint32_t vaddr, uint32_t len, bool is_write)
+{
+    io->niov = 0;
+    io->len = 0;
+
+    while (len > 0 && io->niov < ARRAY_SIZE(io->iov)) {
+        hwaddr paddr = xtensa_sim_phys_addr(call, vaddr);
+        uint32_t page_left =
+            TARGET_PAGE_SIZE - (vaddr & (TARGET_PAGE_SIZE - 1));
+        uint32_t run = page_left < len ? page_left : len;
+        hwaddr sz;
+        void *buf;
+
+        if (paddr == -1) {
+            break;
+        }
+        while (run < len &&
+               xtensa_sim_phys_addr(call, vaddr + run) == paddr + run) {
+            run += len - run < TARGET_PAGE_SIZE ?
+                len - run : TARGET_PAGE_SIZE;
+        }
+
+        sz = run;
+        buf = cpu_physical_memory_map(paddr, &sz, !is_write);
+        if (!buf) {
+            break;
+        }
+        io->iov[io->niov].iov_base = buf;
+        io->iov[io->niov].iov_len = sz;
+        ++io->niov;
+        io->len += sz;
+        vaddr += sz;
+        len -= sz;
+    }
+    return io->niov > 0;
+}
+
+static void xtensa_sim_unmap(XtensaSimIO *io, bool is_write, size_t done)
+{
+    unsigned i;
+
+    for (i = 0; i < io->niov; ++i) {
+        size_t access_len = done < io->iov[i].iov_len ?
+            done : io->iov[i].iov_len;
+
+        cpu_physical_memory_unmap(io->iov[i].iov_base, io->iov[i].iov_len,
+                                  !is_write, access_len);
+        done -= access_len;
+    }
+}
+
+/*
+ * Transfer len bytes between the host file descriptor fd (or the console
+ * when it is not NULL) and the guest buffer at vaddr.
+ * Return the number of bytes transferred or -1 if nothing was transferred
+ * because of an error, guest errno goes to *err.
+ */
+static uint32_t xtensa_sim_rw(const XtensaSimCall *call,
+                              CharBackend *console, int fd,
+                              uint32_t vaddr, uint32_t len, bool is_write,
+                              uint32_t *err)
+{
+    uint32_t len_done = 0;
+
+    *err = 0;
+    while (len > 0) {
+        XtensaSimIO io;
+        ssize_t io_done;
+
+        if (!xtensa_sim_map(call, &io, vaddr, len, is_write)) {
+            *err = TARGET_EINVAL;
+            return len_done ? len_done : -1;
+        }
+
+        if (console) {
+            unsigned i;
+
+            for (i = 0, io_done = 0; i < io.niov; ++i) {
+                int rc = qemu_chr_fe_write_all(console,
+                                               io.iov[i].iov_base,
+                                               io.iov[i].iov_len);
+                if (rc < 0) {
+                    io_done = io_done ? io_done : -1;
+                    break;
+                }
+                io_done += rc;
+                if (rc < io.iov[i].iov_len) {
+                    break;
+                }
+            }
+        } else {
+            io_done = is_write ?
+                writev(fd, io.iov, io.niov) :
+                readv(fd, io.iov, io.niov);
+        }
+        *err = errno_h2g(errno);
+
+        if (io_done == -1) {
+            xtensa_sim_unmap(&io, is_write, 0);
+            return len_done ? len_done : -1;
+        }
+        xtensa_sim_unmap(&io, is_write, io_done);
+        len_done += io_done;
+        vaddr += io_done;
+        len -= io_done;
+        if (io_done < io.len) {
+            break;
+        }
+    }
+    return len_done;
+}
+
+static bool xtensa_sim_get_name(CPUState *cs, uint32_t vaddr,
+                                char *name, size_t size)
+{
+    int rc = 0;
+    int i;
+
+    for (i = 0; i < size; ++i) {
+        rc = cpu_memory_rw_debug(cs, vaddr + i, (uint8_t *)name + i, 1, 0);
+        if (rc != 0 || name[i] == 0) {
+            break;
+        }
+    }
+    return rc == 0 && i < size;
+}
+
+/*
+ * Look up the guest memory used by the simcall in the vCPU thread:
+ * cpu_get_phys_page_debug and cpu_memory_rw_debug use the CPU MMU state.
+ */
+static void xtensa_sim_call_prepare(XtensaSimCall *call)
+{
+    CPUState *cs = call->cs;
+    uint32_t *regs = call->regs;
+
+    call->pages = NULL;
+    call->npages = 0;
+
+    switch (regs[2]) {
+    case TARGET_SYS_open:
+    case TARGET_SYS_read_file:
+        call->name_valid = xtensa_sim_get_name(cs, regs[3], call->name,
+                                               sizeof(call->name));
+        if (regs[2] == TARGET_SYS_open) {
+            break;
+        }
+        /* fall through */
+    case TARGET_SYS_read:
+    case TARGET_SYS_write:
+        if (regs[5]) {
+            uint64_t end = MIN((uint64_t)regs[4] + regs[5] - 1, UINT32_MAX);
+            uint32_t page = regs[4] & TARGET_PAGE_MASK;
+            uint32_t last = end & TARGET_PAGE_MASK;
+            uint32_t i;
+
+            call->npages = ((last - page) >> TARGET_PAGE_BITS) + 1;
+            call->pages = g_new(hwaddr, call->npages);
+            for (i = 0; i < call->npages; ++i) {
+                call->pages[i] = cpu_get_phys_page_debug(cs, page);
+                if (call->pages[i] == -1) {
+                    call->npages = i;
+                    break;
+                }
+                page += TARGET_PAGE_SIZE;
+            }
+        }
+        break;
+
+    case TARGET_SYS_select_one:
+        if (regs[5]) {
+            cpu_memory_rw_debug(cs, regs[5],
+                                (uint8_t *)call->tv, sizeof(call->tv), 0);
+        }
+        break;
+    }
+}
+
+/*
+ * Perform the simcall described by regs[2..6], put the result into
+ * regs[2] and regs[3].
+ */
+static void xtensa_sim_call(XtensaSimCall *call)
+{
+    CPUState *cs = call->cs;
+    uint32_t *regs = call->regs;
 
     switch (regs[2]) {
     case TARGET_SYS_exit:
@@ -180,81 +415,30 @@ void HELPER(simcall)(CPUXtensaState *env)
             uint32_t fd = regs[3];
             uint32_t vaddr = regs[4];
             uint32_t len = regs[5];
-            uint32_t len_done = 0;
-
-            while (len > 0) {
-                hwaddr paddr = cpu_get_phys_page_debug(cs, vaddr);
-                uint32_t page_left =
-                    TARGET_PAGE_SIZE - (vaddr & (TARGET_PAGE_SIZE - 1));
-                uint32_t io_sz = page_left < len ? page_left : len;
-                hwaddr sz = io_sz;
-                void *buf = cpu_physical_memory_map(paddr, &sz, !is_write);
-                uint32_t io_done;
-                bool error = false;
-
-                if (buf) {
-                    vaddr += io_sz;
-                    len -= io_sz;
-                    if (fd < 3 && xtensa_sim_console) {
-                        if (is_write && (fd == 1 || fd == 2)) {
-                            io_done = qemu_chr_fe_write_all(xtensa_sim_console,
-                                                            buf, io_sz);
-                            regs[3] = errno_h2g(errno);
-                        } else {
-                            qemu_log_mask(LOG_GUEST_ERROR,
-                                          "%s fd %d is not supported with chardev console\n",
-                                          is_write ?
-                                          "writing to" : "reading from", fd);
-                            io_done = -1;
-                            regs[3] = TARGET_EBADF;
-                        }
-                    } else {
-                        io_done = is_write ?
-                            write(fd, buf, io_sz) :
-                            read(fd, buf, io_sz);
-                        regs[3] = errno_h2g(errno);
-                    }
-                    if (io_done == -1) {
-                        error = true;
-                        io_done = 0;
-                    }
-                    cpu_physical_memory_unmap(buf, sz, !is_write, io_done);
+
+            if (fd < 3 && xtensa_sim_console) {
+                if (is_write && (fd == 1 || fd == 2)) {
+                    regs[2] = xtensa_sim_rw(call, xtensa_sim_console, fd,
+                                            vaddr, len, true, &regs[3]);
                 } else {
-                    error = true;
-                    regs[3] = TARGET_EINVAL;
-                    break;
-                }
-                if (error) {
-                    if (!len_done) {
-                        len_done = -1;
-                    }
-                    break;
-                }
-                len_done += io_done;
-                if (io_done < io_sz) {
-                    break;
+                    qemu_log_mask(LOG_GUEST_ERROR,
+                                  "%s fd %d is not supported with chardev console\n",
+                                  is_write ?
+                                  "writing to" : "reading from", fd);
+                    regs[2] = -1;
+                    regs[3] = TARGET_EBADF;
                 }
+            } else {
+                regs[2] = xtensa_sim_rw(call, NULL, fd,
+                                        vaddr, len, is_write, &regs[3]);
             }
-            regs[2] = len_done;
         }
         break;
 
     case TARGET_SYS_open:
         {
-            char name[1024];
-            int rc;
-            int i;
-
-            for (i = 0; i < ARRAY_SIZE(name); ++i) {
-                rc = cpu_memory_rw_debug(cs, regs[3] + i,
-                                         (uint8_t *)name + i, 1, 0);
-                if (rc != 0 || name[i] == 0) {
-                    break;
-                }
-            }
-
-            if (rc == 0 && i < ARRAY_SIZE(name)) {
-                regs[2] = open(name, regs[4], regs[5]);
+            if (call->name_valid) {
+                regs[2] = open(call->name, regs[4], regs[5]);
                 regs[3] = errno_h2g(errno);
             } else {
                 regs[2] = -1;
@@ -263,6 +447,33 @@ void HELPER(simcall)(CPUXtensaState *env)
         }
         break;
 
+    case TARGET_SYS_read_file:
+        /*
+         * Read up to a5 bytes at offset a6 of the file named by a3 into
+         * the buffer at a4 in one go, return the number of bytes read.
+         */
+        {
+            int fd;
+
+            if (!call->name_valid) {
+                regs[2] = -1;
+                regs[3] = TARGET_EINVAL;
+                break;
+            }
+            fd = open(call->name, O_RDONLY | O_BINARY);
+            if (fd < 0 || lseek(fd, (off_t)regs[6], SEEK_SET) < 0) {
+                regs[2] = -1;
+                regs[3] = errno_h2g(errno);
+            } else {
+                regs[2] = xtensa_sim_rw(call, NULL, fd,
+                                        regs[4], regs[5], false, &regs[3]);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        break;
+
     case TARGET_SYS_close:
         if (regs[3] < 3) {
             regs[2] = regs[3] = 0;
@@ -282,15 +493,12 @@ void HELPER(simcall)(CPUXtensaState *env)
             uint32_t fd = regs[3];
             uint32_t rq = regs[4];
             uint32_t target_tv = regs[5];
-            uint32_t target_tvv[2];
 
             struct timeval tv = {0};
 
             if (target_tv) {
-                cpu_memory_rw_debug(cs, target_tv,
-                        (uint8_t *)target_tvv, sizeof(target_tvv), 0);
-                tv.tv_sec = (int32_t)tswap32(target_tvv[0]);
-                tv.tv_usec = (int32_t)tswap32(target_tvv[1]);
+                tv.tv_sec = (int32_t)tswap32(call->tv[0]);
+                tv.tv_usec = (int32_t)tswap32(call->tv[1]);
             }
             if (fd < 3 && xtensa_sim_console) {
                 if ((fd == 1 || fd == 2) && rq == SELECT_ONE_WRITE) {
@@ -392,3 +600,86 @@ void HELPER(simcall)(CPUXtensaState *env)
         break;
     }
 }
+
+/*
+ * Host file operations may block for a long time. Unless they go to the
+ * console they can be run in the thread pool while the calling CPU stays
+ * halted and the rest of the system keeps running.
+ */
+static bool xtensa_sim_call_may_block(const uint32_t *regs)
+{
+    switch (regs[2]) {
+    case TARGET_SYS_read:
+    case TARGET_SYS_write:
+    case TARGET_SYS_close:
+    case TARGET_SYS_lseek:
+    case TARGET_SYS_select_one:
+        return !(regs[3] < 3 && xtensa_sim_console);
+
+    case TARGET_SYS_open:
+    case TARGET_SYS_read_file:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static int xtensa_sim_async_worker(void *opaque)
+{
+    XtensaSimCall *call = opaque;
+
+    xtensa_sim_call(call);
+    return 0;
+}
+
+/* Called in the main loop with the BQL held */
+static void xtensa_sim_async_complete(void *opaque, int ret)
+{
+    XtensaSimCall *call = opaque;
+    CPUState *cs = call->cs;
+    CPUXtensaState *env = &XTENSA_CPU(cs)->env;
+
+    env->regs[2] = call->regs[2];
+    env->regs[3] = call->regs[3];
+    env->semihosting_pending = false;
+    cs->halted = 0;
+    qemu_cpu_kick(cs);
+    g_free(call->pages);
+    g_free(call);
+}
+
+/*
+ * SIMCALL ends the TB, so a call that halts the CPU only needs to make it
+ * leave the cpu_exec loop before the next TB.
+ */
+void HELPER(simcall)(CPUXtensaState *env)
+{
+    CPUState *cs = CPU(xtensa_env_get_cpu(env));
+
+    if (env->semihosting_async && xtensa_sim_call_may_block(env->regs)) {
+        XtensaSimCall *call = g_new(XtensaSimCall, 1);
+
+        call->cs = cs;
+        memcpy(call->regs, env->regs, sizeof(call->regs));
+        xtensa_sim_call_prepare(call);
+        env->semihosting_pending = true;
+        cs->halted = 1;
+
+        qemu_mutex_lock_iothread();
+        thread_pool_submit_aio(aio_get_thread_pool(qemu_get_aio_context()),
+                               xtensa_sim_async_worker, call,
+                               xtensa_sim_async_complete, call);
+        qemu_mutex_unlock_iothread();
+
+        cpu_exit(cs);
+    } else {
+        XtensaSimCall call = { .cs = cs };
+
+        memcpy(call.regs, env->regs, sizeof(call.regs));
+        xtensa_sim_call_prepare(&call);
+        xtensa_sim_call(&call);
+        memcpy(env->regs, call.regs, sizeof(call.regs));
+        g_free(call.pages);
+    }
+}
@@ -31,6 +31,7 @@
 #undef DEBUG_JIT
 
 #include "qemu/cutils.h"
+#include "qemu/bitmap.h"
 #include "qemu/host-utils.h"
 #include "qemu/timer.h"
 
@@ -140,6 +141,10 @@ TCGv_env cpu_env = 0;
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * Once all regions have been handed out, the oldest region that no TCG
+ * thread is translating into can be evicted and handed out again, instead
+ * of flushing the whole buffer.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -155,6 +160,9 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    unsigned long *evicted; /* evicted regions, ready to be handed out */
+    uint64_t *seq; /* allocation order of each region */
+    uint64_t next_seq;
 };
 
 static struct tcg_region_state region;
@@ -327,14 +335,34 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t curr_region;
+
+    if (region.current < region.n) {
+        curr_region = region.current++;
+    } else {
+        curr_region = find_first_bit(region.evicted, region.n);
+        if (curr_region == region.n) {
+            return true;
+        }
+        clear_bit(curr_region, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    region.seq[curr_region] = region.next_seq++;
+    tcg_region_assign(s, curr_region);
     return false;
 }
 
+/* Returns the index of the region that contains @p */
+static size_t tcg_region_index(const void *p)
+{
+    size_t idx;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    idx = (p - region.start_aligned) / region.stride;
+    return MIN(idx, region.n - 1);
+}
+
 /*
  * Request a new region once the one in use has filled up.
  * Returns true on error.
@@ -372,6 +400,8 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.next_seq = 0;
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -382,6 +412,56 @@ void tcg_region_reset_all(void)
     qemu_mutex_unlock(&region.lock);
 }
 
+/*
+ * Find the oldest region that has been handed out and that no TCG context
+ * is translating into. Returns false if there is no such region.
+ *
+ * Call from a safe-work context. Once the TBs in [*pstart, *pend) have been
+ * invalidated, the region is returned with tcg_region_evict().
+ */
+bool tcg_region_oldest(size_t *pidx, void **pstart, void **pend)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    unsigned long *busy = bitmap_new(region.n);
+    bool found = false;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    bitmap_copy(busy, region.evicted, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        set_bit(tcg_region_index(s->code_gen_buffer), busy);
+    }
+    for (i = 0; i < region.current; i++) {
+        if (!test_bit(i, busy) &&
+            (!found || region.seq[i] < region.seq[*pidx])) {
+            *pidx = i;
+            found = true;
+        }
+    }
+    qemu_mutex_unlock(&region.lock);
+    g_free(busy);
+
+    if (found) {
+        tcg_region_bounds(*pidx, pstart, pend);
+    }
+    return found;
+}
+
+/* Call from a safe-work context */
+void tcg_region_evict(size_t idx)
+{
+    void *start, *end;
+
+    tcg_region_bounds(idx, &start, &end);
+
+    qemu_mutex_lock(&region.lock);
+    set_bit(idx, region.evicted);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    qemu_mutex_unlock(&region.lock);
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -390,33 +470,32 @@ static size_t tcg_n_regions(void)
 #else
 /*
  * It is likely that some vCPUs will translate more code than others, so we
- * first try to set more regions than max_cpus, with those regions being of
- * reasonable size. If that's not possible we make do by evenly dividing
- * the code_gen_buffer among the vCPUs.
+ * first try to set more regions than vCPU threads, with those regions being
+ * of reasonable size. If that's not possible we make do by evenly dividing
+ * the code_gen_buffer among the vCPU threads.
+ *
+ * Even a single vCPU thread gets several regions, so that filling up the
+ * buffer only evicts the oldest of them.
  */
 static size_t tcg_n_regions(void)
 {
+    size_t n_threads = qemu_tcg_mttcg_enabled() ? max_cpus : 1;
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
-    }
-
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /* Try to have more regions than threads, with each region being >= 2 MB */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
     /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    return n_threads;
 }
 #endif
 
@@ -431,7 +510,8 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG we still use a few regions, so
+ * that a full buffer only evicts the oldest one.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
@@ -481,6 +561,8 @@ void tcg_region_init(void)
     region.stride = region_size;
     region.start = buf;
     region.start_aligned = aligned;
+    region.evicted = bitmap_new(n_regions);
+    region.seq = g_new0(uint64_t, n_regions);
     /* page-align the end, since its last page will be a guard page */
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
@@ -846,6 +846,8 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+bool tcg_region_oldest(size_t *pidx, void **pstart, void **pend);
+void tcg_region_evict(size_t idx);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
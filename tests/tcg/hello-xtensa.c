@@ -0,0 +1,67 @@
+/*
+ * Xtensa Linux syscall and signal delivery smoke test
+ *
+ * xtensa-linux-gcc -nostdlib -static -Wall -Wextra -g -O2 \
+ *                  -o hello-xtensa hello-xtensa.c
+ *
+ * Prints two lines and exits with status 42. The second line is only
+ * printed when SIGUSR1 sent to itself reached the handler and
+ * rt_sigreturn resumed execution with the caller's registers intact.
+ */
+#define __NR_write          13
+#define __NR_exit           118
+#define __NR_getpid         120
+#define __NR_kill           123
+#define __NR_rt_sigaction   226
+
+#define SIGUSR1             10
+
+static inline long syscall4(long nr, long a, long b, long c, long d)
+{
+    register long __a2 asm("a2") = nr;
+    register long __a6 asm("a6") = a;
+    register long __a3 asm("a3") = b;
+    register long __a4 asm("a4") = c;
+    register long __a5 asm("a5") = d;
+
+    __asm__ __volatile__ ("syscall"
+                          : "+r" (__a2)
+                          : "r" (__a6), "r" (__a3), "r" (__a4), "r" (__a5)
+                          : "memory");
+    return __a2;
+}
+
+struct kernel_sigaction {
+    void (*handler)(int);
+    unsigned long flags;
+    void (*restorer)(void);
+    unsigned long mask[2];
+};
+
+static volatile int signalled;
+
+static void handler(int sig)
+{
+    signalled = sig;
+}
+
+static int write(int fd, const char *buf, int len)
+{
+    return syscall4(__NR_write, fd, (long)buf, len, 0);
+}
+
+void _start(void)
+{
+    struct kernel_sigaction sa = { .handler = handler };
+    volatile int canary = 0x12345678;
+
+    write(1, "Hello, World!\n", 14);
+
+    if (syscall4(__NR_rt_sigaction, SIGUSR1, (long)&sa, 0, 8) == 0 &&
+        syscall4(__NR_kill, syscall4(__NR_getpid, 0, 0, 0, 0),
+                 SIGUSR1, 0, 0) == 0 &&
+        signalled == SIGUSR1 && canary == 0x12345678) {
+        write(1, "Signal OK\n", 10);
+    }
+    syscall4(__NR_exit, 42, 0, 0, 0);
+}